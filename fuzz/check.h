@@ -0,0 +1,659 @@
+#ifndef CREGEX_CHECK
+#define CREGEX_CHECK
+
+/*
+    Reference matcher and cross checks of the engines for the fuzz target and the differential harness.
+
+The reference has its own parser and finds all ends of matches from a set of starts with bitsets,
+so it shares no code with the automata. It knows the ascii part of the rules and texts up to
+REF_MAX_TEXT bytes, other inputs are only checked against the other engines of the library.
+*/
+
+#include "cregex.h"
+#include <stdint.h>
+#include <limits.h> // INT_MIN
+
+#define REF_MAX_TEXT 63    // positions of the text fit into uint64_t
+#define REF_MAX_NODES 1024 // nodes of the reference tree
+
+#define CHECK_NOT_COMPILED INT_MIN // checkEngines didn't compile the pattern, no return code of the library is the same
+
+enum refKind
+{
+    REF_BYTES,
+    REF_CONCAT,
+    REF_ALTERNATION,
+    REF_REPEAT,
+    REF_ASSERTION
+};
+
+enum refLook
+{
+    REF_TEXT_START,
+    REF_TEXT_END,
+    REF_LINE_START,
+    REF_LINE_END,
+    REF_WORD,
+    REF_NOT_WORD
+};
+
+typedef struct refNode
+{
+    int kind;
+    int child;               // first child, -1 if there is none
+    int next;                // next child of the parent, -1 ends the list
+    int min, max;            // repetitions, max is -1 without upper bound
+    int look;                // REF_* kind of the assertion
+    unsigned char bytes[32]; // bitmap of bytes of the leaf
+} refNode;
+
+typedef struct reference
+{
+    refNode nodes[REF_MAX_NODES];
+    int count;
+    int root;
+    const char *pattern;
+    int i;
+    bool icase;
+    bool multiline;
+    bool error;
+} reference;
+
+int refAlternation(reference *ref);
+
+int refNew(reference *ref, int kind)
+{
+    if (ref->count == REF_MAX_NODES)
+    {
+        ref->error = true;
+        return 0;
+    }
+    refNode *n = &ref->nodes[ref->count];
+    memset(n, 0, sizeof(refNode));
+    n->kind = kind;
+    n->child = n->next = -1;
+    return ref->count++;
+}
+
+void refAdd(unsigned char *bytes, int first, int last)
+{
+    for (int c = first; c <= last; c++)
+    {
+        bytes[c >> 3] |= 1 << (c & 7);
+    }
+}
+
+bool refHas(const unsigned char *bytes, int c)
+{
+    return bytes[c >> 3] & (1 << (c & 7));
+}
+
+/*
+    Adds bytes of the escaped symbol after '\'.
+*/
+void refEscape(reference *ref, unsigned char *bytes)
+{
+    unsigned char set[32] = {0};
+    char c = ref->pattern[ref->i++];
+    switch (c)
+    {
+    case 'd':
+    case 'D':
+        refAdd(set, '0', '9');
+        break;
+    case 's':
+    case 'S':
+        refAdd(set, '\t', '\r');
+        refAdd(set, ' ', ' ');
+        break;
+    case 'w':
+    case 'W':
+        refAdd(set, '0', '9');
+        refAdd(set, 'A', 'Z');
+        refAdd(set, 'a', 'z');
+        break;
+
+    default:
+        if (c == '\0' || (unsigned char)c >= 0x80)
+        {
+            ref->error = true;
+            return;
+        }
+        refAdd(bytes, c, c);
+        return;
+    }
+    for (int b = 0; b < 32; b++)
+    {
+        bytes[b] |= c >= 'a' ? set[b] : ~set[b];
+    }
+}
+
+/*
+    Reads the class after '[' or "[^".
+*/
+void refClass(reference *ref, unsigned char *bytes)
+{
+    const char *pattern = ref->pattern;
+    for (int element = 0; pattern[ref->i] != ']'; element++)
+    {
+        if (pattern[ref->i] == '\0' || (unsigned char)pattern[ref->i] >= 0x80 || element == 10)
+        {
+            ref->error = true; // the library keeps up to 10 elements
+            return;
+        }
+        if (pattern[ref->i] == '\\')
+        {
+            ++ref->i;
+            refEscape(ref, bytes);
+            continue;
+        }
+        unsigned char first = pattern[ref->i++];
+        if (pattern[ref->i] == '-' && pattern[ref->i + 1] != ']' && pattern[ref->i + 1] != '\0')
+        {
+            unsigned char last = pattern[ref->i + 1];
+            ref->i += 2;
+            ref->error = ref->error || last >= 0x80;
+            refAdd(bytes, first, last);
+        }
+        else
+        {
+            refAdd(bytes, first, first);
+        }
+    }
+    ++ref->i;
+}
+
+/*
+    Reads a group, an assertion or a leaf.
+*/
+int refAtom(reference *ref)
+{
+    const char *pattern = ref->pattern;
+    char c = pattern[ref->i];
+    bool word = c == '\\' && (pattern[ref->i + 1] == 'b' || pattern[ref->i + 1] == 'B');
+    if (c == '^' || c == '$' || word)
+    {
+        int assertion = refNew(ref, REF_ASSERTION);
+        if (word)
+        {
+            ref->nodes[assertion].look = pattern[++ref->i] == 'b' ? REF_WORD : REF_NOT_WORD;
+        }
+        else
+        {
+            int start = ref->multiline ? REF_LINE_START : REF_TEXT_START, end = ref->multiline ? REF_LINE_END : REF_TEXT_END;
+            ref->nodes[assertion].look = c == '^' ? start : end;
+        }
+        ++ref->i;
+        return assertion;
+    }
+    if (c == '(')
+    {
+        ++ref->i;
+        int group = refAlternation(ref);
+        if (pattern[ref->i] != ')')
+        {
+            ref->error = true;
+        }
+        ++ref->i;
+        return group;
+    }
+    if (c == '\0' || strchr("|)+*?{", c) != NULL || (unsigned char)c >= 0x80)
+    {
+        ref->error = true;
+        return -1;
+    }
+
+    int leaf = refNew(ref, REF_BYTES);
+    unsigned char *bytes = ref->nodes[leaf].bytes;
+    bool negated = c == '[' && pattern[ref->i + 1] == '^';
+    ref->i += 1 + negated;
+    if (c == '[')
+    {
+        refClass(ref, bytes);
+    }
+    else if (c == '.')
+    {
+        refAdd(bytes, 0, 0x7f);
+    }
+    else if (c == '\\')
+    {
+        refEscape(ref, bytes);
+    }
+    else
+    {
+        refAdd(bytes, c, c);
+    }
+
+    for (int l = 'a'; ref->icase && l <= 'z'; l++)
+    {
+        if (refHas(bytes, l) || refHas(bytes, l - 'a' + 'A'))
+        {
+            refAdd(bytes, l, l);
+            refAdd(bytes, l - 'a' + 'A', l - 'a' + 'A');
+        }
+    }
+    for (int b = 0; negated && b < 32; b++)
+    {
+        bytes[b] = ~bytes[b];
+    }
+    return leaf;
+}
+
+int refNumber(reference *ref)
+{
+    int n = 0;
+    while (isdigit((unsigned char)ref->pattern[ref->i]) && n < 0x3f3f)
+    {
+        n = n * 10 + ref->pattern[ref->i++] - '0';
+    }
+    ref->error = ref->error || n >= 0x3f3f; // the library takes 0x3f3f for infinity
+    return n;
+}
+
+void refSpaces(reference *ref)
+{
+    while (ref->pattern[ref->i] == ' ')
+    {
+        ++ref->i;
+    }
+}
+
+/*
+    Reads an atom with its quantifiers.
+*/
+int refRepeat(reference *ref)
+{
+    int atom = refAtom(ref);
+    while (!ref->error && ref->pattern[ref->i] != '\0' && strchr("+*?{", ref->pattern[ref->i]) != NULL)
+    {
+        int repeat = refNew(ref, REF_REPEAT);
+        refNode *n = &ref->nodes[repeat];
+        n->child = atom;
+        char c = ref->pattern[ref->i++];
+        n->min = c == '+';
+        n->max = c == '?' ? 1 : -1;
+        if (c == '{')
+        {
+            refSpaces(ref);
+            n->min = n->max = refNumber(ref);
+            refSpaces(ref);
+            if (ref->pattern[ref->i] == ',')
+            {
+                ++ref->i;
+                refSpaces(ref);
+                n->max = isdigit((unsigned char)ref->pattern[ref->i]) ? refNumber(ref) : -1;
+                refSpaces(ref);
+            }
+            if (ref->pattern[ref->i] != '}' || (n->max >= 0 && n->max < n->min))
+            {
+                ref->error = true;
+            }
+            ++ref->i;
+        }
+        atom = repeat;
+    }
+    return atom;
+}
+
+int refConcat(reference *ref)
+{
+    int concat = refNew(ref, REF_CONCAT), last = -1;
+    while (!ref->error && ref->pattern[ref->i] != '\0' && ref->pattern[ref->i] != '|' && ref->pattern[ref->i] != ')')
+    {
+        int item = refRepeat(ref);
+        if (last == -1)
+        {
+            ref->nodes[concat].child = item;
+        }
+        else
+        {
+            ref->nodes[last].next = item;
+        }
+        last = item;
+    }
+    return concat;
+}
+
+int refAlternation(reference *ref)
+{
+    int alternation = refNew(ref, REF_ALTERNATION), last = refConcat(ref);
+    ref->nodes[alternation].child = last;
+    while (!ref->error && ref->pattern[ref->i] == '|')
+    {
+        ++ref->i;
+        int item = refConcat(ref);
+        ref->nodes[last].next = item;
+        last = item;
+    }
+    return alternation;
+}
+
+/*
+    Parses the pattern, returns false if the reference doesn't know it.
+*/
+bool refParse(reference *ref, const char *pattern, int flags)
+{
+    memset(ref, 0, sizeof(reference));
+    ref->icase = flags & RE_ICASE;
+    ref->multiline = flags & RE_MULTILINE;
+    while (strncmp(pattern, "(?i)", 4) == 0 || strncmp(pattern, "(?m)", 4) == 0)
+    {
+        ref->icase = ref->icase || pattern[2] == 'i';
+        ref->multiline = ref->multiline || pattern[2] == 'm';
+        pattern += 4;
+    }
+    ref->pattern = pattern;
+    ref->root = refAlternation(ref);
+    return !ref->error && pattern[ref->i] == '\0';
+}
+
+bool refWord(const unsigned char *text, int length, int p)
+{
+    return p >= 0 && p < length && isalnum(text[p]);
+}
+
+/*
+    Checks the assertion at the position p of the text.
+*/
+bool refHolds(int look, const unsigned char *text, int length, int p)
+{
+    switch (look)
+    {
+    case REF_TEXT_START:
+        return p == 0;
+    case REF_TEXT_END:
+        return p == length;
+    case REF_LINE_START:
+        return p == 0 || text[p - 1] == '\n';
+    case REF_LINE_END:
+        return p == length || text[p] == '\n';
+    case REF_WORD:
+        return refWord(text, length, p - 1) != refWord(text, length, p);
+
+    default:
+        return refWord(text, length, p - 1) == refWord(text, length, p);
+    }
+}
+
+/*
+    Returns the set of positions, where matches of the node from the starts end.
+*/
+uint64_t refEnds(reference *ref, int n, const unsigned char *text, int length, uint64_t starts)
+{
+    refNode *node = &ref->nodes[n];
+    uint64_t ends = 0;
+    switch (node->kind)
+    {
+    case REF_BYTES:
+        for (int p = 0; p < length; p++)
+        {
+            if ((starts >> p & 1) && refHas(node->bytes, text[p]))
+            {
+                ends |= (uint64_t)1 << (p + 1);
+            }
+        }
+        return ends;
+    case REF_ASSERTION:
+        for (int p = 0; p <= length; p++)
+        {
+            if ((starts >> p & 1) && refHolds(node->look, text, length, p))
+            {
+                ends |= (uint64_t)1 << p;
+            }
+        }
+        return ends;
+    case REF_CONCAT:
+        ends = starts;
+        for (int c = node->child; c != -1 && ends != 0; c = ref->nodes[c].next)
+        {
+            ends = refEnds(ref, c, text, length, ends);
+        }
+        return ends;
+    case REF_ALTERNATION:
+        for (int c = node->child; c != -1; c = ref->nodes[c].next)
+        {
+            ends |= refEnds(ref, c, text, length, starts);
+        }
+        return ends;
+
+    default: // REF_REPEAT
+    {
+        uint64_t current = starts;
+        for (int i = 0; i < node->min && current != 0; i++)
+        {
+            uint64_t following = refEnds(ref, node->child, text, length, current);
+            if (following == current)
+            {
+                break; // the rest of repetitions don't change anything
+            }
+            current = following;
+        }
+        // positions reached earlier have more repetitions left, so only new ones are followed
+        uint64_t fresh = current;
+        ends = current;
+        for (int i = node->min; (node->max < 0 || i < node->max) && fresh != 0; i++)
+        {
+            fresh = refEnds(ref, node->child, text, length, fresh) & ~ends;
+            ends |= fresh;
+        }
+        return ends;
+    }
+    }
+}
+
+/*
+    Finds the leftmost-longest match, that starts at from or later, returns its start or -1.
+*/
+int refFind(reference *ref, const unsigned char *text, int length, int from, int *end)
+{
+    for (int start = from; start <= length; start++)
+    {
+        uint64_t ends = refEnds(ref, ref->root, text, length, (uint64_t)1 << start);
+        for (int e = length; e >= start; e--)
+        {
+            if (ends >> e & 1)
+            {
+                *end = e;
+                return start;
+            }
+        }
+    }
+    return -1;
+}
+
+void checkFailed(const char *what, const char *pattern, int flags, const unsigned char *text, size_t length)
+{
+    fprintf(stderr, "%s\npattern (flags %d): %s\ntext:", what, flags, pattern);
+    for (size_t i = 0; i < length; i++)
+    {
+        fprintf(stderr, isprint(text[i]) ? "%c" : "\\x%02x", text[i]);
+    }
+    fprintf(stderr, "\n");
+    abort();
+}
+
+/*
+    Counts the fields of re_split_each.
+*/
+bool countField(const char *field, size_t length, void *context)
+{
+    (void)field;
+    (void)length;
+    ++*(int *)context;
+    return true;
+}
+
+#define CHECK(condition, what) \
+    if (!(condition))          \
+    checkFailed(what, pattern, flags, text, length)
+
+/*
+    Runs every engine of the library on the text and aborts with a report,
+if they disagree with each other or with the reference.
+
+Returns the start of the match, RE_NOMATCH or RE_BUDGET_EXCEEDED, CHECK_NOT_COMPILED if the pattern isn't compiled.
+*/
+int checkEngines(const char *pattern, int flags, const unsigned char *text, size_t length)
+{
+    re r = re_compile_flags(pattern, flags);
+    if (r == NULL)
+    {
+        return CHECK_NOT_COMPILED;
+    }
+    const char *string = (const char *)text;
+
+    // the two pass search is the answer, the other engines are compared with it
+    int end = -1;
+    int start = re_findspan(&r, string, length, &end);
+    if (start == RE_BUDGET_EXCEEDED)
+    {
+        re_free(&r);
+        return start;
+    }
+    CHECK(start == RE_NOMATCH || (start >= 0 && start <= end && end <= (int)length), "span out of the text");
+
+    int searchEnd = -1;
+    CHECK(re_search(&r, string, length, NULL, &searchEnd) == start && searchEnd == end, "re_search differs");
+    CHECK(re_is_match(&r, string, length) == (start >= 0), "re_is_match differs");
+    CHECK(re_test(&r, string, length, NULL) == (start >= 0), "re_test differs");
+
+    re_options options = {length / 2 + 1, 0};
+    int limited = re_search(&r, string, length, &options, &searchEnd);
+    CHECK(limited == RE_BUDGET_EXCEEDED || (limited == start && (start < 0 || searchEnd == end)), "re_search with budget differs");
+
+    // caches, that grew under the default limit, shrink to a smaller one
+    re_options small = {0, 4096};
+    limited = re_search(&r, string, length, &small, &searchEnd);
+    CHECK(limited == RE_BUDGET_EXCEEDED || (limited == start && (start < 0 || searchEnd == end)), "re_search with memory limit differs");
+    re_dfa *dfas[] = {r->search, r->reverse, r->anchored, r->earliest};
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK(dfas[i]->memory <= small.maxMemory || dfas[i]->memory == dfaFootprint(dfas[i], 0, 0, 64), "dfa cache is larger than maxMemory");
+    }
+
+    if (memchr(text, '\0', length) == NULL)
+    {
+        char *copy = (char *)malloc(length + 1);
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+        CHECK(re_match(&r, copy) == (start == 0 && end == (int)length), "re_match differs");
+        free(copy);
+    }
+
+    re_properties info;
+    re_info(&r, &info);
+    if (start >= 0)
+    {
+        size_t matched = end - start;
+        CHECK(info.minLength <= matched && (info.maxLength == RE_UNBOUNDED || matched <= info.maxLength), "length of the match is out of bounds");
+        CHECK(matched == 0 || (info.firstBytes[text[start] >> 3] & (1 << (text[start] & 7))), "first byte of the match isn't in firstBytes");
+        CHECK(info.prefixLength <= matched, "match is shorter than the prefix");
+    }
+
+    int groups = re_groups(&r);
+    re_span *spans = (re_span *)malloc((groups + 1) * sizeof(re_span));
+    CHECK(re_captures(&r, string, length, NULL, spans, groups + 1) == start, "re_captures differs");
+    limited = re_captures(&r, string, length, &options, spans, groups + 1);
+    CHECK(limited == RE_BUDGET_EXCEEDED || limited == start, "re_captures with budget differs");
+    for (int g = 0; start >= 0 && g <= groups; g++)
+    {
+        bool unset = spans[g].start == -1 && spans[g].end == -1;
+        CHECK(unset || (start <= spans[g].start && spans[g].start <= spans[g].end && spans[g].end <= end), "group is out of the match");
+        CHECK(g > 0 || (spans[0].start == start && spans[0].end == end), "group 0 isn't the match");
+    }
+    free(spans);
+
+    // replacing every match with itself gives the text back
+    char *buffer = NULL;
+    size_t capacity;
+    int replaced = re_replace_buffer(&r, string, length, "$0", true, NULL, &buffer, &capacity);
+    CHECK(replaced == RE_BUDGET_EXCEEDED || (replaced == (int)length && memcmp(buffer, text, length) == 0), "re_replace_all changed the text");
+    // the budget is shared by all searches of the call
+    limited = re_replace_buffer(&r, string, length, "$0", true, &options, &buffer, &capacity);
+    CHECK(limited == RE_BUDGET_EXCEEDED || limited == replaced, "re_replace_all with budget differs");
+    free(buffer);
+
+    // fields go in order from the start to the end of the text and the separators don't overlap
+    re_span fields[8];
+    int count = re_split(&r, string, length, NULL, fields, 8);
+    CHECK(count == RE_BUDGET_EXCEEDED || (count >= 1 && count <= 8 && fields[0].start == 0 && fields[count - 1].end == (int)length), "re_split lost the ends of the text");
+    for (int f = 1; f < count; f++)
+    {
+        CHECK(fields[f - 1].start <= fields[f - 1].end && fields[f - 1].end <= fields[f].start, "re_split fields overlap");
+    }
+    CHECK(count != 1 || start < 0 || (start == end && (start == 0 || start == (int)length)), "re_split ignored a separator");
+    limited = re_split(&r, string, length, &options, fields, 8);
+    CHECK(limited == RE_BUDGET_EXCEEDED || limited == count, "re_split with budget differs");
+
+    // in utf-8 mode an empty match steps over a symbol, a lead byte at the end of a buffer without
+    // a terminating zero is a symbol too, the steps mustn't read after the buffer
+    if (flags & RE_UTF8)
+    {
+        unsigned char *cut = (unsigned char *)malloc(length + 1);
+        memcpy(cut, text, length);
+        cut[length] = 0xE2;
+        const char *cutString = (const char *)cut;
+        buffer = NULL;
+        replaced = re_replace_buffer(&r, cutString, length + 1, "$0", true, NULL, &buffer, &capacity);
+        CHECK(replaced == RE_BUDGET_EXCEEDED || (replaced == (int)length + 1 && memcmp(buffer, cut, length + 1) == 0), "re_replace_all changed the cut text");
+        free(buffer);
+        count = re_split(&r, cutString, length + 1, NULL, fields, 8);
+        CHECK(count == RE_BUDGET_EXCEEDED || (count >= 1 && count <= 8 && fields[count - 1].end == (int)length + 1), "re_split lost the end of the cut text");
+        int handed = 0;
+        count = re_split_each(&r, cutString, length + 1, NULL, countField, &handed);
+        CHECK(count == RE_BUDGET_EXCEEDED || (count >= 1 && count == handed), "re_split_each lost fields of the cut text");
+        free(cut);
+    }
+
+    // the stream sees the text as an edit of its first half with one byte checkpoints, then appended
+    re_stream st = re_stream_create(&r, 1);
+    int streamEnd = -1;
+    re_stream_search(&st, string, length / 2, 0, NULL);
+    re_stream_search(&st, string, length, length / 4, NULL);
+    int streamStart = re_stream_search(&st, string, length, length, &streamEnd);
+    CHECK(streamStart == RE_BUDGET_EXCEEDED || (streamStart == start && (start < 0 || streamEnd == end)), "re_stream_search differs");
+    re_stream_free(&st);
+
+    if (start >= 0 && r->onepass)
+    {
+        int width = 2 * (groups + 1);
+        int *onepass = (int *)malloc(width * sizeof(int)), *threads = (int *)malloc(width * sizeof(int));
+        for (int i = 0; i < width; i++)
+        {
+            onepass[i] = threads[i] = -1;
+        }
+        CHECK(onepassCaptures(r, text, start, end, onepass), "one pass has no match");
+        pikeCaptures(r, text, length, start, end, threads);
+        CHECK(memcmp(onepass, threads, width * sizeof(int)) == 0, "one pass captures differ");
+        free(onepass);
+        free(threads);
+    }
+
+    // the reference knows ascii patterns, in utf-8 mode the text should be ascii too
+    static reference ref;
+    bool ascii = true;
+    for (size_t i = 0; i < length && (flags & RE_UTF8); i++)
+    {
+        ascii = ascii && text[i] < 0x80;
+    }
+    if (length <= REF_MAX_TEXT && ascii && refParse(&ref, pattern, flags))
+    {
+        int refEnd = -1;
+        int refStart = refFind(&ref, text, length, 0, &refEnd);
+        CHECK(refStart == start && (start < 0 || refEnd == end), "reference differs");
+
+        // the search from the middle sees the bytes before it
+        int from = (int)length / 2;
+        int fromEnd = -1;
+        int fromStart = re_search_from(&r, string, length, from, NULL, &fromEnd);
+        refStart = refFind(&ref, text, length, from, &refEnd);
+        CHECK(fromStart == refStart && (refStart < 0 || fromEnd == refEnd), "re_search_from differs");
+    }
+
+    re_free(&r);
+    return start;
+}
+
+#undef CHECK
+
+#endif
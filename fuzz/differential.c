@@ -0,0 +1,245 @@
+/*
+    Differential harness: random patterns and texts are run through every engine of the library,
+the reference and POSIX regexec, which also finds leftmost-longest matches. Groups of patterns,
+that are followed in one pass, are compared with POSIX submatches. Utf-8 patterns are checked
+against a table of known spans.
+
+gcc -g -O2 -fsanitize=address,undefined -Iinclude fuzz/differential.c -o differential
+./differential [iterations] [seed]
+
+With -DCREGEX_STATS the counters of every search are checked too.
+*/
+#include "check.h"
+#include <regex.h>
+
+typedef struct generator
+{
+    char pattern[1024]; // the rules of the library
+    char posix[1024];   // the same in extended POSIX syntax
+    int length, posixLength;
+    bool multiline;     // REG_NEWLINE keeps '.' and negated classes from matching '\n', so they aren't used
+} generator;
+
+void emit(generator *g, const char *pattern, const char *posix)
+{
+    size_t length = strlen(pattern), posixLength = strlen(posix);
+    if (g->length + length < sizeof(g->pattern) && g->posixLength + posixLength < sizeof(g->posix))
+    {
+        memcpy(g->pattern + g->length, pattern, length + 1);
+        memcpy(g->posix + g->posixLength, posix, posixLength + 1);
+        g->length += length;
+        g->posixLength += posixLength;
+    }
+}
+
+void generateAlternation(generator *g, int depth);
+
+void generateAtom(generator *g, int depth)
+{
+    static const char *atoms[][2] = {
+        {"a", "a"}, {"b", "b"}, {"c", "c"}, {"A", "A"}, {"[ab]", "[ab]"}, {"[b-c]", "[b-c]"}, {"\\d", "[0-9]"},
+        {"\\w", "[[:alnum:]]"}, {"\\s", "[[:space:]]"}, {".", "."}, {"[^a]", "[^a]"}, {"[^ab]", "[^ab]"}};
+    static const char *anchors[] = {"^", "$", "\\b", "\\B"};
+    static const char *quantifiers[] = {"+", "*", "?", "{2}", "{1,2}", "{0,2}", "{2,}"};
+
+    int choice = rand() % 18;
+    if (choice >= 16 && depth == 0)
+    {
+        // glibc gets anchors in repeated groups wrong and POSIX leaves repeated anchors undefined
+        emit(g, anchors[choice - 16], anchors[choice - 16]);
+        return;
+    }
+    choice %= 16;
+    if (choice < 12 || depth == 3)
+    {
+        choice %= g->multiline ? 9 : 12;
+        emit(g, atoms[choice][0], atoms[choice][1]);
+    }
+    else
+    {
+        emit(g, "(", "(");
+        generateAlternation(g, depth + 1);
+        emit(g, ")", ")");
+    }
+    int quantifier = rand() % 12;
+    if (quantifier < 7)
+    {
+        emit(g, quantifiers[quantifier], quantifiers[quantifier]);
+    }
+}
+
+void generateAlternation(generator *g, int depth)
+{
+    int alternatives = rand() % 3 == 0 ? 2 + rand() % 2 : 1;
+    for (int a = 0; a < alternatives; a++)
+    {
+        if (a > 0)
+        {
+            emit(g, "|", "|");
+        }
+        for (int atoms = 1 + rand() % 3; atoms > 0; atoms--)
+        {
+            generateAtom(g, depth);
+        }
+    }
+}
+
+/*
+    Match of a utf-8 pattern, that POSIX can't check without a locale.
+*/
+typedef struct knownSpan
+{
+    const char *pattern;
+    int flags;
+    const char *text;
+    int start;
+    int end;
+} knownSpan;
+
+/*
+    Runs the patterns of the table through every engine, returns the number of wrong spans.
+*/
+long checkKnownSpans(void)
+{
+    static const knownSpan table[] = {
+        {"[^\xc3\xa9]", RE_UTF8, "\xc3\xa9", -1, -1},
+        {"[^\xc3\xa9]", RE_UTF8, "a\xc3\xa9", 0, 1},
+        {"[^\xc3\xa9]+", RE_UTF8, "\xc3\xa9\xc3\xa9" "a\xc3\xa9", 4, 5},
+        {"^.{2}$", RE_UTF8, "\xc3\xa9\xf0\x9f\x98\x80", 0, 6},
+        {".", RE_UTF8, "\xf0\x9f\x98\x80", 0, 4},
+        {"\xc3\xa9+", RE_UTF8, "x\xc3\xa9\xc3\xa9", 1, 5},
+        {"[\xc3\xa0-\xc3\xbf]", RE_UTF8, "a\xc3\xbf", 1, 3},
+        {"(\xc3\xa9)(.)", RE_UTF8, "x\xc3\xa9\xf0\x9f\x98\x80", 1, 7},
+        {"\\W", RE_UTF8, "\xc3\xa9", 0, 2},
+        {"x*", RE_UTF8, "\xe2", 0, 0}, // a lead byte, that is cut by the end of the text
+        {"[^a]", 0, "\xc3\xa9", 0, 1}, // bytes without RE_UTF8
+        {".", 0, "\xc3\xa9", -1, -1},  // '.' is an ascii byte without RE_UTF8
+    };
+
+    long wrong = 0;
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+    {
+        const knownSpan *known = &table[i];
+        int length = (int)strlen(known->text), end = -1;
+        int start = checkEngines(known->pattern, known->flags, (const unsigned char *)known->text, length);
+        re r = re_compile_flags(known->pattern, known->flags);
+        re_findspan(&r, known->text, length, &end);
+        re_free(&r);
+        if (start != known->start || (start >= 0 && end != known->end))
+        {
+            printf("known span differs: /%s/ on '%s': %d,%d, known %d,%d\n", known->pattern, known->text, start, end, known->start, known->end);
+            ++wrong;
+        }
+    }
+    return wrong;
+}
+
+#ifdef CREGEX_STATS
+/*
+    Checks, that the counters of a new pattern follow a single search and are cleared by re_stats_reset.
+*/
+bool statsAgree(const char *pattern, int flags, const char *text, int length)
+{
+    re r = re_compile_flags(pattern, flags);
+    re_stats stats, zero;
+    memset(&zero, 0, sizeof(zero));
+    re_stats_snapshot(&r, &stats);
+    bool fresh = memcmp(&stats, &zero, sizeof(zero)) == 0;
+
+    int end;
+    int start = re_search(&r, text, length, NULL, &end);
+    re_stats_snapshot(&r, &stats);
+    // a nonempty match can't be found without reading its bytes
+    bool moved = stats.calls == 1 && stats.matches == (start >= 0) && (start < 0 || end == start || stats.bytes > 0);
+
+    re_stats_reset(&r);
+    re_stats_snapshot(&r, &stats);
+    bool cleared = memcmp(&stats, &zero, sizeof(zero)) == 0;
+    re_free(&r);
+    return fresh && moved && cleared;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 10000;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+
+    long texts = 0, skipped = 0, mismatches = checkKnownSpans();
+    for (long it = 0; it < iterations; it++)
+    {
+        generator g;
+        g.length = g.posixLength = 0;
+        g.pattern[0] = g.posix[0] = '\0';
+        g.multiline = rand() % 4 == 0;
+        generateAlternation(&g, 0);
+        int flags = (rand() % 4 == 0 ? RE_ICASE : 0) | (g.multiline ? RE_MULTILINE : 0);
+
+        regex_t posix;
+        int posixFlags = REG_EXTENDED | (flags & RE_ICASE ? REG_ICASE : 0) | (g.multiline ? REG_NEWLINE : 0);
+        if (regcomp(&posix, g.posix, posixFlags) != 0)
+        {
+            ++skipped;
+            continue;
+        }
+        for (int t = 0; t < 16; t++)
+        {
+            char text[32];
+            int length = rand() % 24;
+            for (int i = 0; i < length; i++)
+            {
+                text[i] = g.multiline ? "abcAB1 \n"[rand() % 8] : "abcAB1 x"[rand() % 8];
+            }
+            text[length] = '\0';
+
+            int start = checkEngines(g.pattern, flags, (const unsigned char *)text, length);
+            if (start == CHECK_NOT_COMPILED)
+            {
+                ++skipped; // too many states
+                break;
+            }
+            // POSIX takes the longest submatches and the library the greedy path, they are the same,
+            // when the next byte always determines the state; for other patterns glibc can spend
+            // exponential time on submatches, so only the match is compared
+            re r = re_compile_flags(g.pattern, flags);
+            size_t count = r->onepass && re_groups(&r) == (int)posix.re_nsub ? posix.re_nsub + 1 : 1;
+            regmatch_t *match = (regmatch_t *)malloc(count * sizeof(regmatch_t));
+            bool found = regexec(&posix, text, count, match, 0) == 0;
+            if (start != RE_BUDGET_EXCEEDED && (found != (start >= 0) || (found && start != match[0].rm_so)))
+            {
+                printf("POSIX differs: /%s/ (%s) on '%s': %d, POSIX %d\n", g.pattern, g.posix, text, start, found ? (int)match[0].rm_so : -1);
+                ++mismatches;
+            }
+            else if (found && start >= 0)
+            {
+                // groups of both syntaxes are numbered by the same '('
+                re_span *spans = (re_span *)malloc(count * sizeof(re_span));
+                re_captures(&r, text, length, NULL, spans, (int)count);
+                for (size_t i = 0; i < count; i++)
+                {
+                    if (spans[i].start != match[i].rm_so || spans[i].end != match[i].rm_eo)
+                    {
+                        printf("POSIX differs: /%s/ (%s) on '%s': group %zu %d,%d, POSIX %d,%d\n", g.pattern, g.posix, text, i,
+                               spans[i].start, spans[i].end, (int)match[i].rm_so, (int)match[i].rm_eo);
+                        ++mismatches;
+                        break;
+                    }
+                }
+                free(spans);
+            }
+            re_free(&r);
+            free(match);
+#ifdef CREGEX_STATS
+            if (!statsAgree(g.pattern, flags, text, length))
+            {
+                printf("stats differ: /%s/ on '%s'\n", g.pattern, text);
+                ++mismatches;
+            }
+#endif
+            ++texts;
+        }
+        regfree(&posix);
+    }
+    printf("patterns %ld texts %ld skipped %ld mismatches %ld\n", iterations, texts, skipped, mismatches);
+    return mismatches != 0;
+}
@@ -0,0 +1,63 @@
+/*
+    Fuzz target over re_compile and every matching engine.
+
+The input is a byte of flags, the pattern up to the first zero byte and the text after it.
+
+libFuzzer:
+clang -g -O1 -fsanitize=fuzzer,address,undefined -DCREGEX_LIBFUZZER -Iinclude fuzz/fuzz.c -o fuzz-cregex
+./fuzz-cregex -max_len=256 corpus/
+
+AFL, the input is read from the file in the argument or from stdin:
+afl-clang-fast -g -O1 -Iinclude fuzz/fuzz.c -o fuzz-cregex
+afl-fuzz -i seeds -o findings -- ./fuzz-cregex @@
+*/
+#include "check.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+    int flags = data[0] & (RE_UTF8 | RE_LOCALE | RE_ICASE | RE_MULTILINE);
+    const uint8_t *zero = (const uint8_t *)memchr(data + 1, '\0', size - 1);
+    size_t patternLength = zero != NULL ? (size_t)(zero - data - 1) : size - 1;
+
+    char *pattern = (char *)malloc(patternLength + 1);
+    memcpy(pattern, data + 1, patternLength);
+    pattern[patternLength] = '\0';
+    const uint8_t *text = zero != NULL ? zero + 1 : data + size;
+    checkEngines(pattern, flags, text, data + size - text);
+    free(pattern);
+    return 0;
+}
+
+#ifndef CREGEX_LIBFUZZER
+int main(int argc, char **argv)
+{
+    FILE *file = argc > 1 ? fopen(argv[1], "rb") : stdin;
+    if (file == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    size_t size = 0, capacity = 4096;
+    uint8_t *data = (uint8_t *)malloc(capacity);
+    for (size_t read; (read = fread(data + size, 1, capacity - size, file)) > 0;)
+    {
+        size += read;
+        if (size == capacity)
+        {
+            capacity *= 2;
+            data = (uint8_t *)realloc(data, capacity);
+        }
+    }
+    if (file != stdin)
+    {
+        fclose(file);
+    }
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+#endif
@@ -2,6 +2,7 @@
 #define C_REGEX
 
 #include <stdbool.h>
+#include <stddef.h> // size_t
 #include <locale.h>
 
 /*
@@ -15,7 +16,13 @@ RULES:
 \W - nonalphanumeric
 
 [] - class
-() - group, nested groups are not allowed
+[^] - negated class
+() - group
+| - alternation
+^ - start of the string, in multiline mode also start of a line
+$ - end of the string, in multiline mode also end of a line
+\b - word boundary: between \w and \W bytes or the ends of the string
+\B - not a word boundary
 
 + - 1..inf
 * - 0..inf
@@ -23,12 +30,31 @@ RULES:
 {n} - n
 {n,} - n..inf
 {n,m} - n..m
+
+(?i) - at the beginning of the pattern, case insensitive matching
+(?m) - at the beginning of the pattern, multiline mode
 */
 typedef struct regex *re;
 
 #define MAX_PATTERN_LENGTH 100 // maximum number of states in automata
 #define MAX_CLASS_LENGTH 10    // maximum number of elements per class (except of range)
-#define MAX_GROUP_LENGTH 10    // maximum number of elements in group ()
+#define MAX_DFA_MEMORY (1 << 22) // default memory limit of every dfa cache in bytes
+
+#define RE_NOMATCH -1         // nothing corresponds to the regular expression
+#define RE_BUDGET_EXCEEDED -2 // matching was stopped by the limits of re_options
+#define RE_TOO_LONG -3        // the string or the result is longer than INT_MAX bytes, so its indices don't fit in int
+
+/*
+    Limits of a single call.
+
+maxSteps - maximal number of bytes read by automata, 0 - unlimited
+maxMemory - maximal memory of every dfa cache of the pattern in bytes, 0 - MAX_DFA_MEMORY
+*/
+typedef struct re_options
+{
+    size_t maxSteps;
+    size_t maxMemory;
+} re_options;
 
 /*
     Compiles the regular expression.
@@ -38,8 +64,33 @@ pattern - the regular expression, that corresponds to defined rules
 */
 re re_compile(const char *pattern);
 
+#define RE_UTF8 1      // pattern and strings are utf-8 encoded, symbols and classes stand for codepoints
+#define RE_LOCALE 2    // \d, \s and \w follow the current ctype locale instead of ascii
+#define RE_ICASE 4     // ascii letters match regardless of their case, the same as (?i)
+#define RE_MULTILINE 8 // ^ and $ match at '\n' too, the same as (?m)
+
+/*
+    Compiles the regular expression with flags.
+
+Arguments:
+pattern - the regular expression, that corresponds to defined rules
+flags - combination of RE_* flags
+*/
+re re_compile_flags(const char *pattern, int flags);
+
 void re_print(re *pattern);
 
+/*
+    Prints the plan of matching, that re_compile has chosen for the pattern: the prefilter,
+the search engine and the captures engine, then sizes of the tables and the memory.
+
+Dfa states are built lazily, so their sizes and flushes are the ones of the calls made so far.
+
+Arguments:
+pattern - compiled regular expression
+*/
+void re_explain(re *pattern);
+
 /*
     Checks if input string fully matches the regular expression.
 
@@ -76,42 +127,392 @@ string - string to be processed
 */
 int re_findp(const char *pattern, const char *string);
 
+/*
+    Finds the leftmost-longest substring in string that corresponds to the regular expression.
+
+The end of the match is found by the forward pass of the automata, then the start of the match
+is found by the backward pass of the reversed automata, that starts from that end.
+
+Arguments:
+pattern - compiled regular expression
+string - string to be processed
+length - number of bytes in string
+end - pointer to store the index right after the last byte of the match, can be NULL
+
+Returns the index of the first byte of the match or -1
+(RE_BUDGET_EXCEEDED if a dfa state doesn't fit in MAX_DFA_MEMORY, RE_TOO_LONG if length > INT_MAX).
+*/
+int re_findspan(re *pattern, const char *string, size_t length, int *end);
+
+/*
+    Finds the leftmost-longest substring like re_findspan within the limits of a single call.
+
+Arguments:
+pattern - compiled regular expression
+string - string to be processed
+length - number of bytes in string
+options - limits of the call, can be NULL
+end - pointer to store the index right after the last byte of the match, can be NULL
+
+Returns the index of the first byte of the match, RE_NOMATCH, RE_BUDGET_EXCEEDED or RE_TOO_LONG.
+*/
+int re_search(re *pattern, const char *string, size_t length, const re_options *options, int *end);
+
+/*
+    Finds the leftmost-longest substring like re_search, that starts at from or later.
+
+Bytes before from aren't matched, but ^ and \b see them, so the search can continue after
+the previous match.
+
+Arguments:
+from - index of the byte to start with
+
+Returns the index of the first byte of the match, RE_NOMATCH, RE_BUDGET_EXCEEDED or RE_TOO_LONG.
+*/
+int re_search_from(re *pattern, const char *string, size_t length, size_t from, const re_options *options, int *end);
+
+/*
+    Checks if input string contains a substring like re_is_match within the limits of a single call.
+
+Arguments:
+pattern - compiled regular expression
+string - string to be checked
+length - number of bytes in string
+options - limits of the call, can be NULL
+
+Returns 1 if there is a match, 0 if there is not or RE_BUDGET_EXCEEDED.
+*/
+int re_test(re *pattern, const char *string, size_t length, const re_options *options);
+
+/*
+    Checks if input string contains a substring that corresponds to the regular expression.
+
+Stops at the first byte, where any match is completed, without finding its boundaries.
+
+Arguments:
+pattern - compiled regular expression
+string - string to be checked
+length - number of bytes in string
+*/
+bool re_is_match(re *pattern, const char *string, size_t length);
+
+#define RE_UNBOUNDED ((size_t)-1) // maximal length of the match without limit
+
+/*
+    Properties of the compiled regular expression, that are computed by re_compile.
+*/
+typedef struct re_properties
+{
+    size_t minLength;             // minimal length of the match
+    size_t maxLength;             // maximal length of the match or RE_UNBOUNDED
+    unsigned char firstBytes[32]; // bitmap of bytes, that a nonempty match can start with
+    size_t prefixLength;          // length of the literal, that every match starts with
+    bool literal;                 // the pattern corresponds only to its prefix
+} re_properties;
+
+/*
+    Reports the properties of the compiled regular expression.
+
+Arguments:
+pattern - compiled regular expression
+info - properties
+*/
+void re_info(re *pattern, re_properties *info);
+
+/*
+    Boundaries of a group in the string, both are -1 if the group doesn't take part in the match.
+*/
+typedef struct re_span
+{
+    int start;
+    int end; // index right after the last byte
+} re_span;
+
+/*
+    Returns the number of () groups of the compiled regular expression.
+*/
+int re_groups(re *pattern);
+
+/*
+    Finds the leftmost-longest substring like re_findspan and the boundaries of its groups.
+
+Patterns, where the next byte always determines the next state, are followed in one pass with a single
+thread; others run all threads at once over the found match. Groups take the greedy path: repetitions
+are extended first and earlier alternatives are preferred. A group, that matched the empty string,
+is reported as the empty span at its place, a repetition of such a group takes one empty iteration.
+
+Arguments:
+pattern - compiled regular expression
+string - string to be processed
+length - number of bytes in string
+options - limits of the call, can be NULL
+spans - array for the whole match followed by groups in the order of their '('
+count - number of elements in spans
+
+Returns the index of the first byte of the match, RE_NOMATCH, RE_BUDGET_EXCEEDED or RE_TOO_LONG.
+*/
+int re_captures(re *pattern, const char *string, size_t length, const re_options *options, re_span *spans, int count);
+
+/*
+    Replaces the leftmost-longest match with the replacement and writes the result into out.
+
+The replacement can refer to groups: $0 .. $9 or ${n} stand for the match and its groups,
+groups, that don't take part in the match, are empty, $$ stands for $.
+Like snprintf, the result is cut to capacity - 1 bytes and terminated with zero, if capacity > 0.
+Without a match the result is the copy of string.
+
+Arguments:
+pattern - compiled regular expression
+string - string to be processed
+length - number of bytes in string
+replacement - zero terminated replacement
+options - limits of the whole call, can be NULL
+out - buffer for the result, can be NULL if capacity is 0
+capacity - size of out
+
+Returns the length of the whole result without the terminating zero, RE_BUDGET_EXCEEDED or RE_TOO_LONG.
+*/
+int re_replace(re *pattern, const char *string, size_t length, const char *replacement, const re_options *options, char *out, size_t capacity);
+
+/*
+    Replaces every match like re_replace in a single scan of string.
+
+Matches don't overlap, an empty match is followed by the next symbol, that is kept.
+*/
+int re_replace_all(re *pattern, const char *string, size_t length, const char *replacement, const re_options *options, char *out, size_t capacity);
+
+/*
+    Replaces the first or every match like re_replace and re_replace_all into the buffer,
+that grows with realloc when the result doesn't fit, so it can be reused between calls.
+
+Arguments:
+all - replace every match
+buffer - pointer to the buffer, that was allocated with malloc, or to NULL
+capacity - pointer to the size of the buffer, it is updated when the buffer grows
+
+Returns the length of the result without the terminating zero, RE_BUDGET_EXCEEDED or RE_TOO_LONG.
+*/
+int re_replace_buffer(re *pattern, const char *string, size_t length, const char *replacement, bool all, const re_options *options, char **buffer, size_t *capacity);
+
+/*
+    Splits string into fields separated by matches of the regular expression in a single scan.
+
+Fields are spans of string, nothing is copied. An empty match separates symbols, but it doesn't
+make empty fields at the start of a field or at the end of string.
+If there are more fields than count, the last one takes the rest of string.
+
+Arguments:
+pattern - compiled regular expression of the separator
+string - string to be split
+length - number of bytes in string
+options - limits of the whole call, can be NULL
+fields - array for the fields
+count - number of elements in fields
+
+Returns the number of stored fields, RE_BUDGET_EXCEEDED or RE_TOO_LONG.
+*/
+int re_split(re *pattern, const char *string, size_t length, const re_options *options, re_span *fields, int count);
+
+/*
+    Receives a field of re_split_each, returns false to stop splitting.
+
+Arguments:
+field - pointer to the first byte of the field in string
+length - number of bytes in the field
+context - context of re_split_each
+*/
+typedef bool (*re_split_callback)(const char *field, size_t length, void *context);
+
+/*
+    Splits string like re_split, every field is handed to the callback as soon as its end is found.
+
+Returns the number of fields handed to the callback, RE_BUDGET_EXCEEDED or RE_TOO_LONG.
+*/
+int re_split_each(re *pattern, const char *string, size_t length, const re_options *options, re_split_callback callback, void *context);
+
+typedef struct re_stream_state *re_stream;
+
+/*
+    Creates the state of the incremental search for a buffer, that is searched again after appends or edits.
+
+The forward pass of the search is checkpointed every interval bytes, so the next search rescans only
+from the last checkpoint before the first changed byte. The previous result is taken as it is,
+if the search had finished before that byte.
+
+Arguments:
+pattern - compiled regular expression, it has to outlive the stream
+interval - distance between checkpoints in bytes, 0 - 4096
+*/
+re_stream re_stream_create(re *pattern, size_t interval);
+
+/*
+    Finds the leftmost-longest match like re_findspan in the current contents of the buffer.
+
+Arguments:
+stream - state of the incremental search
+buffer - current contents of the buffer
+length - number of bytes in buffer
+unchanged - number of leading bytes, that are the same as in the previous call:
+the previous length after an append, the offset of an edit, 0 if it is unknown
+end - pointer to store the index right after the last byte of the match, can be NULL
+
+Returns the index of the first byte of the match, RE_NOMATCH, RE_BUDGET_EXCEEDED or RE_TOO_LONG.
+*/
+int re_stream_search(re_stream *stream, const char *buffer, size_t length, size_t unchanged, int *end);
+
+/*
+    Frees the state of the incremental search.
+
+Arguments:
+stream - state of the incremental search, it is set to NULL
+*/
+void re_stream_free(re_stream *stream);
+
+#ifdef CREGEX_STATS
+/*
+    Counters of the compiled regular expression, that are collected when CREGEX_STATS is defined.
+*/
+typedef struct re_stats
+{
+    unsigned long long calls;          // calls of re_match, re_search, re_test and functions built on them
+    unsigned long long bytes;          // bytes read by automata or skipped by prefilter
+    unsigned long long matches;        // calls, that found a match
+    unsigned long long states;         // dfa states visited
+    unsigned long long prefilterCalls; // scans for the literal prefix or the first bytes
+    unsigned long long prefilterHits;  // scans, that found a place to start matching
+    unsigned long long cacheMisses;    // dfa transitions, that were computed
+    unsigned long long nanoseconds;    // total time spent in calls
+} re_stats;
+
+/*
+    Callback, that is called after a call, that took at least the threshold.
+*/
+typedef void (*re_slow_hook)(re pattern, unsigned long long nanoseconds, void *context);
+
+/*
+    Copies the counters of the compiled regular expression.
+
+Arguments:
+pattern - compiled regular expression
+stats - counters
+*/
+void re_stats_snapshot(re *pattern, re_stats *stats);
+
+/*
+    Resets the counters of the compiled regular expression.
+
+Arguments:
+pattern - compiled regular expression
+*/
+void re_stats_reset(re *pattern);
+
+/*
+    Sets the callback for slow calls.
+
+Arguments:
+pattern - compiled regular expression
+threshold - minimal duration of the call in nanoseconds
+hook - callback, NULL to remove it
+context - passed to the callback
+*/
+void re_stats_hook(re *pattern, unsigned long long threshold, re_slow_hook hook, void *context);
+#endif
+
+/*
+    Frees the compiled regular expression.
+
+Arguments:
+pattern - compiled regular expression, it is set to NULL
+*/
+void re_free(re *pattern);
+
 #define CREGEX_IMPLEMENTATION
 
 #include <stdlib.h> // NULL
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <limits.h> // INT_MAX
+
+#ifdef CREGEX_STATS
+#include <time.h> // clock_gettime, timespec_get or clock
+
+#define RE_STATS_BEGIN(reg) \
+    unsigned long long statsStarted = statsClock(); \
+    ++(reg)->stats.calls
+#define RE_STATS_END(reg, matched) statsFinish(reg, statsStarted, matched)
+#define RE_STATS_STEP(reg) (++(reg)->stats.states, ++(reg)->stats.bytes)
+#define RE_STATS_PREFILTER(reg, found, skipped) \
+    (++(reg)->stats.prefilterCalls, \
+     (reg)->stats.prefilterHits += (found), \
+     (reg)->stats.bytes += (skipped))
+#define RE_STATS_MISS(d) ++(d)->misses
+#else
+#define RE_STATS_BEGIN(reg)
+#define RE_STATS_END(reg, matched)
+#define RE_STATS_STEP(reg)
+#define RE_STATS_PREFILTER(reg, found, skipped)
+#define RE_STATS_MISS(d)
+#endif
 
 /*
     Struct that represents a range on the alphabet.
 
 In normal case start < finish, in case of '^' finish < start.
 */
-typedef struct range
+typedef struct re_range
 {
     // first position in alphabet
-    unsigned short start;
+    unsigned int start;
 
     // last position in alphabet
-    unsigned short finish;
-} range;
+    unsigned int finish;
+} re_range;
+
+enum
+{
+    RE_FIRST,
+    RE_LAST,
+    RE_REGULAR,
+    RE_NONE,
+    RE_RANGE,
+    RE_SYMBOL,
+    RE_DOT,
+    RE_NUMERIC,         // \d
+    RE_NONNUMERIC,      // \D
+    RE_SPACE,           // \s
+    RE_NONSPACE,        // \S
+    RE_ALPHANUMERIC,    // \w
+    RE_NONALPHANUMERIC, // \W
+    RE_ASSERTION        // state of ^, $, \b or \B, its symbol holds the RE_LOOK_* bit
+};
 
+// bits of the class tables: \d, \s and \w
 enum
 {
-    FIRST,
-    LAST,
-    REGULAR,
-    NONE,
-    RANGE,
-    SYMBOL,
-    DOT,
-    NUMERIC,        // \d
-    NONNUMERIC,     // \D
-    SPACE,          // \s
-    NONSPACE,       // \S
-    ALPHANUMERIC,   // \w
-    NONALPHANUMERIC // \W
+    RE_CLASS_DIGIT = 1,
+    RE_CLASS_SPACE = 2,
+    RE_CLASS_WORD = 4
+};
+
+// ascii semantics of \d, \s and \w, independent of the locale
+static const unsigned char asciiClasses[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 0, 0, 0, 0, 0, 0,
+    0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0,
+    0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 };
 
 /*
@@ -119,16 +520,16 @@ enum
 
 Can be either single element (including special symbol), class or range
 */
-typedef struct symbol
+typedef struct re_symbol
 {
     unsigned char type;
     union
     {
-        unsigned char element;
+        unsigned int element; // byte or, in utf-8 mode, codepoint
         //unsigned char *elements; // CLASS
-        range rng; // RANGE
+        re_range rng; // RE_RANGE
     } value;
-} symbol;
+} re_symbol;
 
 /*
     State of the automata
@@ -137,705 +538,485 @@ symbols - nonzero array of symbols in state
 min - minimal number of symbol repetitions
 max - maximal number of symbol repetitions
 */
-typedef struct state
+typedef struct re_state
 {
-    unsigned char type; //  REGULAR or NONE (NONE  in case of '^' prefix)
-    symbol symbols[MAX_CLASS_LENGTH + 1];
+    unsigned char type; //  RE_REGULAR or RE_NONE (RE_NONE  in case of '^' prefix)
+    re_symbol symbols[MAX_CLASS_LENGTH + 1];
     unsigned short min; // minimal number of elements in state
     unsigned short max; // maximal number of elements in state
-} state;
+} re_state;
 
-typedef struct regex
+#define RE_INFINITY_REPETITIONS 0x3f3f // max of the state without upper bound
+#define RE_MAX_CODEPOINT 0x10FFFF
+#define RE_MAX_CLASS_RANGES ((MAX_CLASS_LENGTH + 1) * 65 * 3 + 1) // codepoint ranges of one state in utf-8 mode
+#define RE_EPSILON -1                  // label of the transition, that doesn't consume a byte
+#define RE_END_OF_INPUT 256            // column of the dfa transitions for the end of the string
+#define RE_ASSERTION_LABEL(look) (RE_EPSILON - (look)) // label of the transition, that checks the assertion
+#define RE_LABEL_LOOK(label) (RE_EPSILON - (label))    // assertion of the label below RE_EPSILON
+
+// assertions, that transitions of the byte automata check instead of consuming a byte
+enum
 {
-    state *states;
-    bool nfa[MAX_PATTERN_LENGTH][MAX_PATTERN_LENGTH];
-    int size;
-} regex;
+    RE_LOOK_TEXT_START = 1, // ^
+    RE_LOOK_TEXT_END = 2,   // $
+    RE_LOOK_LINE_START = 4, // ^ in multiline mode
+    RE_LOOK_LINE_END = 8,   // $ in multiline mode
+    RE_LOOK_WORD = 16,      // \b
+    RE_LOOK_NOT_WORD = 32   // \B
+};
 
-bool matchState(state *st, const char c);
+/*
+    Transition of the byte automata.
 
-re re_compile(const char *pattern)
+target - node, that is reached by the transition
+label - index of the byte set in automata, RE_EPSILON or RE_ASSERTION_LABEL of a RE_LOOK_* assertion
+*/
+typedef struct re_transition
 {
-    static regex reg;
-    reg.states = (state *)malloc((MAX_PATTERN_LENGTH + 1) * sizeof(state));
-    reg.states[0].type = FIRST; // flag for beginning
+    int target;
+    int label;
+} re_transition;
 
-    unsigned int i = 0; // index in pattern
-    unsigned int j = 1; // index in reg
+/*
+    Byte automata, that is built from the states of the regular expression.
 
-    int lastGroupElements[MAX_GROUP_LENGTH], lastGroupElement = -1, lastGroupInsideBracket = 0;
-    int groupLastElements[MAX_PATTERN_LENGTH], groupLastElement = 0;
-    int groupFirstElements[MAX_PATTERN_LENGTH], groupFirstElement = 0;
-    int lastOutput[MAX_PATTERN_LENGTH], lastOutputLength = 0;
-    bool isVariation = false, variationBeforeGroup = false, neighbourVariation = false;
+Every state is unrolled into a chain of nodes, one node per repetition, so the automata
+can be walked byte by byte without counting repetitions.
+Transitions of the node n are transitions[offsets[n]] .. transitions[offsets[n + 1] - 1].
+Bytes, that belong to the same byte sets, can't be told apart by any transition, so they share
+a byte class and dfas keep one column of transitions per class.
+*/
+typedef struct re_automata
+{
+    int size;   // number of nodes
+    int start;  // initial node
+    int accept; // final node, it has no transitions
+    int *offsets;
+    re_transition *transitions;
+    unsigned char (*sets)[32]; // bitmaps of bytes, that are consumed by transitions
+    int setsCount;
+    unsigned short columns[RE_END_OF_INPUT + 1]; // column of the dfa transitions for every byte and RE_END_OF_INPUT
+    int width;                                   // number of byte classes plus one for RE_END_OF_INPUT
+    int looks;                                   // RE_LOOK_* assertions of transitions
+    unsigned char words[32];                     // bytes of \w, that \b looks at
+} re_automata;
 
-    for (size_t i = 0; i < MAX_GROUP_LENGTH; i++)
-    {
-        lastGroupElements[i] = -1;
-    }
-    for (size_t i = 0; i < MAX_PATTERN_LENGTH; i++)
-    {
-        groupLastElements[i] = -1;
-    }
+enum
+{
+    RE_DFA_ANCHORED = 1, // match can start only at the first byte
+    RE_DFA_LEFTMOST = 2  // threads are grouped by the position they started at
+};
 
-    while (pattern[i] != '\0' && (j + 1 < MAX_PATTERN_LENGTH))
-    {
-        // ranges are not allowed in []-scope
-        switch (pattern[i])
-        {
-        case '^':
-            if (pattern[i + 1] == '\0' || pattern[i + 1] == '|' || pattern[i + 1] == '(')
-            {
-                return 0; // this rules are not allowed
-            }
+enum
+{
+    RE_STATE_INJECT = 1,         // new thread is started at every byte
+    RE_STATE_MATCH = 2,          // match ends right before the byte, that leads to the state
+    RE_STATE_DEAD = 4,           // there are no threads left
+    RE_STATE_AT_START = 8,       // context of assertions: there is no byte before the state
+    RE_STATE_AFTER_NEWLINE = 16, // context of assertions: the byte before the state is '\n'
+    RE_STATE_AFTER_WORD = 32,    // context of assertions: the byte before the state is a \w byte
+    RE_STATE_START = 64          // initial state of its context, the flag isn't a part of the key
+};
+#define RE_STATE_CONTEXT (RE_STATE_AT_START | RE_STATE_AFTER_NEWLINE | RE_STATE_AFTER_WORD)
 
-            reg.states[j].type = NONE;
-            ++i;
-            continue; // save state
-            break;
-        case '.':
-            if (lastGroupElement != -1)
-            {
-                lastGroupElements[lastGroupElement] = j;
-                ++lastGroupElement;
-            }
+/*
+    Lazy deterministic automata over the byte automata.
 
-            // first element in variation
-            if (!isVariation && lastGroupElement == -1 && pattern[i + 1] == '|')
-            {
-                isVariation = true;
-                groupFirstElements[groupFirstElement] = j;
-                ++groupFirstElement;
-            }
-            // last element in variation
-            if (isVariation && lastGroupElement == -1 && pattern[i + 1] != '|' && pattern[i + 1] != '*' && pattern[i + 1] != '+' && pattern[i + 1] != '?' && pattern[i + 1] != '{') //  && pattern[i - 1] == '|'
-            {
-                isVariation = false;
-                groupLastElements[groupLastElement] = j;
-                ++groupLastElement;
-            }
+State of the dfa is a list of groups of nodes. In leftmost mode every group holds threads,
+that started at the same position, and groups are ordered by that position, so the match
+of the earliest thread wins. Otherwise there is only one group.
+Key of the state i is keys[keyOffsets[i]] .. keys[keyOffsets[i + 1] - 1]:
+flags, then every group as its length followed by sorted nodes.
+Threads wait before transitions of assertions: the flags keep the context of the byte before
+the state, and the assertions are checked with the next byte, when the transition is computed.
+*/
+typedef struct re_dfa
+{
+    re_automata *nfa;
+    unsigned char kind;
+    int starts[RE_STATE_CONTEXT / RE_STATE_AT_START + 1]; // initial state of every context, -1 if not built yet
 
-            if (!reg.states[j].type) // "^."
-            {
-                reg.states[j].type = REGULAR;
-            }
+    int count; // number of states
+    int capacity;
+    int *transitions; // nfa->width per state, -1 if not computed yet
+    unsigned char *flags;
+    int *keyOffsets;
 
-            reg.states[j].symbols[0].value.element = pattern[i];
-            reg.states[j].symbols[0].type = DOT;
-            reg.states[j].symbols[1].type = LAST;
-            reg.states[j].min = 1;
-            reg.states[j].max = 1;
+    int *keys;
+    int keysCount;
+    int keysCapacity;
 
-            break;
-        case '\\':
-            if (pattern[i + 1] != '\0')
-            {
-                if (lastGroupElement != -1)
-                {
-                    lastGroupElements[lastGroupElement] = j;
-                    ++lastGroupElement;
-                }
+    int *table; // open addressing hash table of states
+    int tableSize;
 
-                // first element in variation
-                if (!isVariation && lastGroupElement == -1 && pattern[i + 2] == '|')
-                {
-                    isVariation = true;
-                    groupFirstElements[groupFirstElement] = j;
-                    ++groupFirstElement;
-                }
-                // last element in variation
-                if (isVariation && lastGroupElement == -1 && pattern[i + 2] != '|' && pattern[i + 2] != '*' && pattern[i + 2] != '+' && pattern[i + 2] != '?' && pattern[i + 2] != '{')
-                {
-                    isVariation = false;
-                    groupLastElements[groupLastElement] = j;
-                    ++groupLastElement;
-                }
+    int *marks; // generation of the last visit per node
+    int generation;
+    int *stack;
+    int *buffer; // key under construction
 
-                ++i;
-                if (!reg.states[j].type)
-                {
-                    reg.states[j].type = REGULAR;
-                }
-                reg.states[j].symbols[0].value.element = pattern[i];
+    int *expanded; // group of the key with nodes behind the assertions, that hold
+    int *passed;   // expansion of the last visit per node
+    int expansions;
 
-                switch (pattern[i])
-                {
-                case 'd':
-                    reg.states[j].symbols[0].type = NUMERIC;
-                    break;
-                case 'D':
-                    reg.states[j].symbols[0].type = NONNUMERIC;
-                    break;
-                case 's':
-                    reg.states[j].symbols[0].type = SPACE;
-                    break;
-                case 'S':
-                    reg.states[j].symbols[0].type = NONSPACE;
-                    break;
-                case 'w':
-                    reg.states[j].symbols[0].type = ALPHANUMERIC;
-                    break;
-                case 'W':
-                    reg.states[j].symbols[0].type = NONALPHANUMERIC;
-                    break;
+    size_t memory; // allocated bytes
+    size_t limit;  // maximal memory, the cache is flushed when it is reached
+    unsigned int flushes;
+#ifdef CREGEX_STATS
+    unsigned long long misses; // computed transitions
+#endif
+} re_dfa;
 
-                default:
-                    break;
-                }
-                reg.states[j].symbols[1].type = LAST;
-                reg.states[j].min = 1;
-                reg.states[j].max = 1;
-            }
-            break;
-        case '[':
-        {
-            if (lastGroupElement != -1)
-            {
-                lastGroupElements[lastGroupElement] = j;
-                ++lastGroupElement;
-            }
+/*
+    Group, that contains a state: number of the group and depth of its node in the syntax tree.
+*/
+typedef struct re_membership
+{
+    int group;
+    int depth;
+} re_membership;
 
-            if (!reg.states[j].type)
-            {
-                reg.states[j].type = REGULAR;
-            }
-            int element = 0; // index in reg.states[j].symbols
+enum
+{
+    RE_PREFILTER_NONE,        // every byte is read by the automata
+    RE_PREFILTER_PREFIX,      // the literal prefix is searched
+    RE_PREFILTER_FIRST_BYTES, // bytes, that can't start a match, are skipped
+    RE_PREFILTER_LINE_START   // the match starts with ^ in multiline mode, '\n' is searched
+};
 
-            ++i;
-            while (pattern[i] != ']' && pattern[i] != '\0')
-            {
-                // '.' and '^' doesn`t work`s as DOT in []-scope
-                // only ranges, elements and specials
+enum
+{
+    RE_ANCHOR_NONE, // the match can start anywhere
+    RE_ANCHOR_TEXT, // every match starts with ^, so only at the start of the string
+    RE_ANCHOR_LINE  // every match starts with ^ in multiline mode, so only at the start of a line
+};
 
-                // range
-                if (pattern[i + 1] == '-')
-                {
-                    reg.states[j].symbols[element].value.rng.start = (int)pattern[i];
-                    reg.states[j].symbols[element].value.rng.finish = (int)pattern[i + 2];
-                    reg.states[j].symbols[element].type = RANGE;
-
-                    i += 3;
-                    ++element;
-                    continue;
-                }
-                // elements and specials
-                switch (pattern[i])
-                {
-                case '\\':
-                    if (pattern[i])
-                    {
-                        ++i;
-                        reg.states[j].symbols[element].value.element = pattern[i];
-                        switch (pattern[i])
-                        {
-                        case 'd':
-                            reg.states[j].symbols[element].type = NUMERIC;
-                            break;
-                        case 'D':
-                            reg.states[j].symbols[element].type = NONNUMERIC;
-                            break;
-                        case 's':
-                            reg.states[j].symbols[element].type = SPACE;
-                            break;
-                        case 'S':
-                            reg.states[j].symbols[element].type = NONSPACE;
-                            break;
-                        case 'w':
-                            reg.states[j].symbols[element].type = ALPHANUMERIC;
-                            break;
-                        case 'W':
-                            reg.states[j].symbols[element].type = NONALPHANUMERIC;
-                            break;
-
-                        default:
-                            reg.states[j].symbols[element].type = SYMBOL; // '-' stands for range, so you should to write '\-'
-                            break;
-                        }
-                    }
-                    break;
-
-                default:
-                    reg.states[j].symbols[element].value.element = pattern[i];
-                    reg.states[j].symbols[element].type = SYMBOL;
-
-                    break;
-                }
-
-                ++element;
-                ++i;
-            }
-
-            // added && lastGroupElement == -1
-            // first element in variation
-            if (!isVariation && lastGroupElement == -1 && pattern[i + 1] == '|')
-            {
-                isVariation = true;
-                groupFirstElements[groupFirstElement] = j;
-                ++groupFirstElement;
-            }
-            // last element in variation //  && flag
-            if (isVariation && lastGroupElement == -1 && pattern[i + 1] != '|' && pattern[i + 1] != '*' && pattern[i + 1] != '+' && pattern[i + 1] != '?' && pattern[i + 1] != '{')
-            {
-                isVariation = false;
-                groupLastElements[groupLastElement] = j;
-                ++groupLastElement;
-            }
-
-            reg.states[j].symbols[element].type = LAST;
-            reg.states[j].min = 1;
-            reg.states[j].max = 1;
-
-            break;
-        }
-        // loops
-        case '+': // 1 .. inf
-            if (i == 0 || (i != 0 && pattern[i - 1] == '|'))
-            {
-                return 0;
-            }
-
-            --j;
-            // first element in variation
-            if (!isVariation && lastGroupElement == -1 && pattern[i + 1] == '|')
-            {
-                isVariation = true;
-                groupFirstElements[groupFirstElement] = j;
-                ++groupFirstElement;
-            }
-            // last element in variation
-            if (isVariation && lastGroupElement == -1 && pattern[i + 1] != '|') //  && pattern[i - 1] == '|'
-            {
-                isVariation = false;
-                groupLastElements[groupLastElement] = j;
-                ++groupLastElement;
-            }
-
-            reg.states[j].min = 1;
-            reg.states[j].max = 0x3f3f; // infinity
-            break;
-        case '*': // 0 .. inf
-            if (i == 0 || (i != 0 && pattern[i - 1] == '|'))
-            {
-                return 0;
-            }
-
-            --j;
-            // first element in variation
-            if (!isVariation && lastGroupElement == -1 && pattern[i + 1] == '|')
-            {
-                isVariation = true;
-                groupFirstElements[groupFirstElement] = j;
-                ++groupFirstElement;
-            }
-            // last element in variation
-            if (isVariation && lastGroupElement == -1 && pattern[i + 1] != '|') //  && pattern[i - 1] == '|'
-            {
-                isVariation = false;
-                groupLastElements[groupLastElement] = j;
-                ++groupLastElement;
-            }
+enum
+{
+    RE_ENGINE_DFA,    // two pass search of the lazy dfas
+    RE_ENGINE_LITERAL // the pattern is its prefix, the search is a scan for it
+};
 
-            reg.states[j].min = 0;
-            reg.states[j].max = 0x3f3f; // infinity
-            break;
-        case '?': // 0 .. 1
-            if (i == 0 || (i != 0 && pattern[i - 1] == '|'))
-            {
-                return 0;
-            }
+enum
+{
+    RE_CAPTURES_NONE,    // no groups, the span of the match is enough
+    RE_CAPTURES_ONEPASS, // the only thread over the match
+    RE_CAPTURES_THREADS  // all threads over the match in the order of their priority
+};
 
-            --j;
-            // first element in variation
-            if (!isVariation && lastGroupElement == -1 && pattern[i + 1] == '|')
-            {
-                isVariation = true;
-                groupFirstElements[groupFirstElement] = j;
-                ++groupFirstElement;
-            }
-            // last element in variation
-            if (isVariation && lastGroupElement == -1 && pattern[i + 1] != '|') //  && pattern[i - 1] == '|'
-            {
-                isVariation = false;
-                groupLastElements[groupLastElement] = j;
-                ++groupLastElement;
-            }
+typedef struct regex
+{
+    re_state *states;
+    bool nfa[MAX_PATTERN_LENGTH][MAX_PATTERN_LENGTH];
+    bool finals[MAX_PATTERN_LENGTH]; // states, that the match can end with
 
-            reg.states[j].min = 0;
-            reg.states[j].max = 1;
-            break;
-        case '{':
-        {
-            if (i == 0 || (i != 0 && pattern[i - 1] == '|'))
-            {
-                return 0;
-            }
+    // the edge j -> k leaves groups of j and enters groups of k, that are deeper than edgeDepth[j][k];
+    // NULL if the pattern has no groups
+    short (*edgeDepth)[MAX_PATTERN_LENGTH];
+    // the edge j -> k also passes the groups of the set skips[j][k] with the empty string,
+    // skips[j][0] is the set after the final state j; NULL if no edge passes an empty group
+    short (*skips)[MAX_PATTERN_LENGTH];
+    int *skipOffsets; // groups of the set s: skipGroups[skipOffsets[s]] .. skipGroups[skipOffsets[s + 1] - 1]
+    int *skipGroups;
+    int skipCount; // the set 0 is empty
+    int groups;
+    int *memberOffsets; // groups of the state k: members[memberOffsets[k]] .. members[memberOffsets[k + 1] - 1]
+    re_membership *members;
+    int size;
+    int flags; // RE_* flags of re_compile_flags
+    unsigned char classes[256]; // RE_CLASS_* bits of every byte
 
-            int n = 0;
-            int m;
+    re_automata *forward;  // byte automata
+    re_automata *backward; // reversed byte automata
+    re_dfa *search;        // unanchored leftmost forward pass
+    re_dfa *reverse;       // anchored backward pass
+    re_dfa *anchored;      // anchored forward pass for full matches
+    re_dfa *earliest;      // unanchored forward pass, that stops at the first match
 
-            ++i;
-            while (pattern[i] == ' ')
-            {
-                ++i;
-            }
-            while (isdigit(pattern[i]))
-            {
-                n = n * 10 + (pattern[i] - '0');
-                ++i;
-            }
-            while (pattern[i] == ' ')
-            {
-                ++i;
-            }
-            if (pattern[i] == ',')
-            {
-                m = 0x3f3f;
-                ++i;
-            }
-            else
-            {
-                m = n;
-            }
-            while (pattern[i] == ' ')
-            {
-                ++i;
-            }
-            if (pattern[i] != '}')
-            {
-                m = 0;
-                while (isdigit(pattern[i]))
-                {
-                    m = m * 10 + (pattern[i] - '0');
-                    ++i;
-                }
-            }
-            while (pattern[i] != '}')
-            {
-                ++i;
-            }
+    unsigned char *prefix; // literal, that every match starts with
+    int prefixLength;
+    bool literal; // the prefix is the only string, that corresponds to the regular expression
+    bool prefixFolded; // the prefix is lowercase and compared ignoring ascii case
 
-            --j;
-            // first element in variation
-            if (!isVariation && lastGroupElement == -1 && pattern[i + 1] == '|')
-            {
-                isVariation = true;
-                groupFirstElements[groupFirstElement] = j;
-                ++groupFirstElement;
-            }
-            // last element in variation
-            if (isVariation && lastGroupElement == -1 && pattern[i + 1] != '|') //  && pattern[i - 1] == '|'
-            {
-                isVariation = false;
-                groupLastElements[groupLastElement] = j;
-                ++groupLastElement;
-            }
-            reg.states[j].min = n;
-            reg.states[j].max = m;
-        }
-        break;
+    size_t minLength;
+    size_t maxLength;
+    unsigned char firstBytes[256]; // nonzero for bytes, that a match can start with
 
-        // group
-        case '(':
-            if (lastGroupInsideBracket != 0) // inside a group
-            {
-                if (!reg.states[j].type)
-                {
-                    reg.states[j].type = REGULAR;
-                }
-                reg.states[j].symbols[0].value.element = pattern[i];
-                reg.states[j].symbols[0].type = SYMBOL;
-                reg.states[j].symbols[1].type = LAST;
-                reg.states[j].min = 1;
-                reg.states[j].max = 1;
+    unsigned char (*bytes)[32]; // byte mode: bytes of every state
+    int *rangeOffsets;          // utf-8 mode: codepoints of the state k are ranges[rangeOffsets[k]] ..
+    re_range *ranges;
+    bool onepass;         // the next byte determines the next state
+    short (*successors)[256]; // one pass mode: the state, that the byte leads to after the state, or -1
 
-                ++lastGroupInsideBracket;
+    unsigned char anchoring; // RE_ANCHOR_*
 
-                lastGroupElements[lastGroupElement] = j;
-                ++lastGroupElement;
-            }
-            else // open a group
-            {
-                variationBeforeGroup = i != 0 && pattern[i - 1] == '|' ? true : false;
+    // plan of matching
+    unsigned char prefilter; // RE_PREFILTER_*
+    unsigned char engine;    // RE_ENGINE_*
+    unsigned char capturing; // RE_CAPTURES_*
 
-                lastGroupElement = 0;
-                ++lastGroupInsideBracket; // open bracket
-                ++i;
-                continue;
-            }
-            break;
-        case ')':
-            if (lastGroupInsideBracket != 1) // doesn't close the group: if equals to 0 it's outside, otherwise inside
-            {
-                if (!reg.states[j].type)
-                {
-                    reg.states[j].type = REGULAR;
-                }
-                reg.states[j].symbols[0].value.element = pattern[i];
-                reg.states[j].symbols[0].type = SYMBOL;
-                reg.states[j].symbols[1].type = LAST;
-                reg.states[j].min = 1;
-                reg.states[j].max = 1;
+#ifdef CREGEX_STATS
+    re_stats stats;
+    re_slow_hook slowHook;
+    unsigned long long slowThreshold;
+    void *slowContext;
+#endif
+} re_regex;
 
-                if (lastGroupInsideBracket != 0)
-                {
-                    --lastGroupInsideBracket;
+enum
+{
+    RE_PASS_FINISHED, // all threads died or the end of the text is read
+    RE_PASS_PAUSED    // the pass has reached the stop position
+};
 
-                    lastGroupElements[lastGroupElement] = j;
-                    ++lastGroupElement;
-                }
-            }
-            else // close a group
-            {
-                // loop for group
-                switch (pattern[i + 1])
-                {
-                case '+': // 1 .. inf
-                    ++i;
-                    for (size_t k = 0; k < lastGroupElement; k++)
-                    {
-                        reg.states[lastGroupElements[k]].min = 1;
-                        reg.states[lastGroupElements[k]].max = 0x3f3f;
-                    }
-                    break;
-                case '*': // 0 .. inf
-                    ++i;
-                    for (size_t k = 0; k < lastGroupElement; k++)
-                    {
-                        reg.states[lastGroupElements[k]].min = 0;
-                        reg.states[lastGroupElements[k]].max = 0x3f3f;
-                    }
-                    break;
-                case '?': // 0 .. 1
-                    ++i;
-                    for (size_t k = 0; k < lastGroupElement; k++)
-                    {
-                        reg.states[lastGroupElements[k]].min = 0;
-                        reg.states[lastGroupElements[k]].max = 1;
-                    }
-                    break;
-                case '{':
-                {
-                    int n = 0;
-                    int m;
-
-                    ++i;
-                    ++i;
-                    while (pattern[i] == ' ')
-                    {
-                        ++i;
-                    }
-                    while (isdigit(pattern[i]))
-                    {
-                        n = n * 10 + (pattern[i] - '0');
-                        ++i;
-                    }
-                    while (pattern[i] == ' ')
-                    {
-                        ++i;
-                    }
-                    if (pattern[i] == ',')
-                    {
-                        m = 0x3f3f;
-                        ++i;
-                    }
-                    else
-                    {
-                        m = n;
-                    }
-                    while (pattern[i] == ' ')
-                    {
-                        ++i;
-                    }
-                    if (pattern[i] != '}')
-                    {
-                        m = 0;
-                        while (isdigit(pattern[i]))
-                        {
-                            m = m * 10 + (pattern[i] - '0');
-                            ++i;
-                        }
-                    }
-                    while (pattern[i] != '}')
-                    {
-                        ++i;
-                    }
-                    //++i;
-
-                    for (size_t k = 0; k < lastGroupElement; k++)
-                    {
-                        reg.states[lastGroupElements[k]].min *= n;
-                        reg.states[lastGroupElements[k]].max = reg.states[lastGroupElements[k]].max == 0x3f3f ? reg.states[lastGroupElements[k]].max : reg.states[lastGroupElements[k]].max * m;
-                    }
-                }
-                break;
+/*
+    Place of the forward pass of the search.
+*/
+typedef struct re_checkpoint
+{
+    size_t position;      // next byte to read
+    int state;            // dfa state before that byte
+    int last;             // end of the last match seen or RE_NOMATCH
+    size_t horizon;       // the pass depends only on bytes before horizon, length + 1 means the end of the text
+    unsigned int flushes; // state is valid while the dfa is flushed that many times
+} re_checkpoint;
 
-                default:
-                    break;
-                }
+/*
+    Incremental search over a buffer, that changes between calls: checkpoints of the forward pass
+every interval bytes and the result of the last call.
+*/
+typedef struct re_stream_state
+{
+    re_regex *reg;
+    size_t interval;
+    re_checkpoint *checkpoints;
+    int count;
+    int capacity;
+    re_checkpoint final; // where the forward pass of the last call has finished
+    int start;           // result of the last call
+    int end;
+    bool cached; // the result of the last call is known
+} re_stream_state;
 
-                // first element in variation
-                if (!isVariation && pattern[i + 1] == '|')
-                {
-                    isVariation = true;
-                    groupFirstElements[groupFirstElement] = lastGroupElements[0];
-                    ++groupFirstElement;
-                }
-                // last element in variation
-                if (isVariation && pattern[i + 1] != '|' && variationBeforeGroup)
-                {
-                    isVariation = false;
-                    groupLastElements[groupLastElement] = lastGroupElements[lastGroupElement - 1];
-                    ++groupLastElement;
-                }
+enum
+{
+    RE_NODE_LEAF,        // single state with its repetitions
+    RE_NODE_EMPTY,       // empty string
+    RE_NODE_CONCAT,      // children one after another
+    RE_NODE_ALTERNATION, // one of children
+    RE_NODE_REPEAT,      // child from min to max times
+    RE_NODE_GROUP        // child in ()
+};
 
-                --lastGroupInsideBracket;
+/*
+    Node of the syntax tree of the pattern.
 
-                // group straight case
-                for (size_t k = 1; k < lastGroupElement; k++)
-                {
-                    reg.nfa[lastGroupElements[k - 1]][lastGroupElements[k]] = 1;
-                }
-                neighbourVariation = neighbourVariation && lastGroupElement != -1;
+Children are linked through next, -1 ends the list.
+*/
+typedef struct re_node
+{
+    unsigned char kind;
+    int child;
+    int next;
+    unsigned short min; // RE_NODE_REPEAT
+    unsigned short max;
+    int group;   // RE_NODE_GROUP: number of the group from 1
+    re_state st; // RE_NODE_LEAF
+} re_node;
 
-                // case, when group is the last variable in variation
-                if (groupLastElement != 0 && !isVariation)
-                {
-                    for (size_t k = 0; k < groupLastElement; k++)
-                    {
-                        reg.nfa[groupLastElements[k]][groupLastElements[groupLastElement - 1] + 1] = 1; // column
-
-                        if (!neighbourVariation)
-                        {
-                            reg.nfa[groupFirstElements[0] - 1][groupFirstElements[k]] = 1; // row
-                        }
-                        else
-                        {
-                            for (size_t l = 0; l < lastOutputLength; l++)
-                            {
-                                reg.nfa[lastOutput[l]][groupFirstElements[k]] = 1;
-                            }
-                        }
-                    }
-
-                    for (size_t k = 0; k < groupLastElement; k++)
-                    {
-                        lastOutput[k] = groupLastElements[k];
-                        neighbourVariation = true;
-                    }
-                    lastOutputLength = groupLastElement != 0 ? groupLastElement : 0;
-
-                    groupFirstElement = 0;
-                    groupLastElement = 0;
-                }
+typedef struct re_parser
+{
+    const char *pattern;
+    size_t length; // bytes in pattern
+    size_t i;      // index in pattern
+    bool utf8;
+    bool multiline;
+    bool error;
+    int depth; // nesting of groups
 
-                ++i;
-                lastGroupElement = -1;
-                continue;
-            }
-            break;
+    re_node *nodes;
+    int count;
+    int capacity;
+    int groups;
 
-        // variation
-        case '|':
-            if (lastGroupInsideBracket == 0) // only outside a group
-            {
-                // except of the last element
-                if (i != 0) // both in case of element and group
-                {
-                    groupLastElements[groupLastElement] = j - 1;
-                    ++groupLastElement;
-                    groupFirstElements[groupFirstElement] = j;
-                    ++groupFirstElement;
-                    --j;
-                }
+    re_membership open[MAX_PATTERN_LENGTH]; // groups around the node under construction
+    int openCount;
+    bool ambiguous; // an edge is created by two nodes, so it leaves or enters different groups
+} re_parser;
 
-                if (pattern[i + 1] == '\0')
-                {
-                    printf("'|' is not allowed at the end of re!\n");
-                    return 0;
-                }
-            }
+/*
+    Glushkov sets of the node: states, that can be the first and the last ones in its match.
+*/
+typedef struct re_positions
+{
+    bool first[MAX_PATTERN_LENGTH];
+    bool last[MAX_PATTERN_LENGTH];
+    bool nullable; // the node matches the empty string
 
-            break;
+    // sets of groups, that match the empty string before the first state, after the last state
+    // and on the empty path of the node, 0 if the node isn't nullable
+    short firstSkips[MAX_PATTERN_LENGTH];
+    short lastSkips[MAX_PATTERN_LENGTH];
+    short emptySkips;
+} re_positions;
 
-        default:
-            if (lastGroupElement != -1)
-            {
-                lastGroupElements[lastGroupElement] = j;
-                ++lastGroupElement;
-            }
+static bool matchState(re_state *st, unsigned char c, const unsigned char *classes);
+static void appendInt(int **array, int *count, int *capacity, int value);
+static int parseAlternation(re_parser *p);
+static int optimizeNode(re_parser *p, int n);
+static bool buildStates(re_regex *reg, re_parser *p, int n, int depth, re_positions *out);
+static void setSkips(re_regex *reg, int j, int k, short set);
+static void collectBytes(re_regex *reg, re_state *st, unsigned char *bits);
+static int codepointRanges(re_state *st, re_range *ranges, const unsigned char *classes, bool icase);
+static void analyzeGroups(re_regex *reg, bool ambiguous);
+static bool onepassCaptures(re_regex *reg, const unsigned char *text, int start, int end, int *captures);
+static void pikeCaptures(re_regex *reg, const unsigned char *text, size_t length, int start, int end, int *captures);
+static void findCaptures(re_regex *reg, const unsigned char *text, size_t length, int start, int end, int *captures);
+static bool assertionHolds(re_regex *reg, int look, const unsigned char *text, size_t length, size_t position);
+static void planMatching(re_regex *reg);
+static unsigned int readSymbol(const char *pattern, size_t available, bool utf8, unsigned int *length);
+static void printSymbol(const char *name, unsigned int symbol);
+static re_automata *buildAutomata(re_regex *reg, bool reverse);
+static void freeAutomata(re_automata *nfa);
+static void findByteClasses(re_automata *nfa);
+static re_dfa *createDfa(re_automata *nfa, unsigned char kind);
+static void freeDfa(re_dfa *d);
+static size_t dfaFootprint(re_dfa *d, int capacity, int keysCapacity, int tableSize);
+static void dfaFlush(re_dfa *d);
+static size_t automataFootprint(re_automata *nfa);
+static int dfaContext(re_dfa *d, int previous);
+static bool dfaAssertion(re_dfa *d, int look, int context, int c);
+static int dfaExpand(re_dfa *d, const int *nodes, int count, int context, int c);
+static int dfaStart(re_dfa *d, int previous);
+static int dfaNext(re_dfa *d, int s, int c);
+static void findPrefix(re_regex *reg);
+static void analyzeAutomata(re_regex *reg);
+static size_t skipStart(re_regex *reg, const unsigned char *text, size_t from, size_t length);
+static int forwardPass(re_regex *reg, const unsigned char *text, size_t length, size_t stop, size_t *budget, re_checkpoint *at);
+static int backwardPass(re_regex *reg, const unsigned char *text, size_t length, size_t from, int last, size_t *budget);
+static const unsigned char *scanPrefix(re_regex *reg, const unsigned char *from, const unsigned char *to);
+static unsigned char otherCase(unsigned char c);
+#ifdef CREGEX_STATS
+static unsigned long long statsClock(void);
+static void statsFinish(re_regex *reg, unsigned long long started, bool matched);
+#endif
 
-            // first element in variation
-            if (!isVariation && lastGroupElement == -1 && pattern[i + 1] == '|')
-            {
-                isVariation = true;
-                groupFirstElements[groupFirstElement] = j;
-                ++groupFirstElement;
-            }
-            // last element in variation
-            if (isVariation && lastGroupElement == -1 && pattern[i + 1] != '|' && pattern[i + 1] != '*' && pattern[i + 1] != '+' && pattern[i + 1] != '?' && pattern[i + 1] != '{') //  && pattern[i - 1] == '|'
-            {
-                isVariation = false;
-                groupLastElements[groupLastElement] = j;
-                ++groupLastElement;
-            }
+re re_compile(const char *pattern)
+{
+    return re_compile_flags(pattern, 0);
+}
 
-            if (!reg.states[j].type)
-            {
-                reg.states[j].type = REGULAR;
-            }
-            reg.states[j].symbols[0].value.element = pattern[i];
-            reg.states[j].symbols[0].type = SYMBOL;
-            reg.states[j].symbols[1].type = LAST;
-            reg.states[j].min = 1;
-            reg.states[j].max = 1;
+re re_compile_flags(const char *pattern, int flags)
+{
+    for (;; pattern += 4)
+    {
+        if (strncmp(pattern, "(?i)", 4) == 0)
+        {
+            flags |= RE_ICASE;
+        }
+        else if (strncmp(pattern, "(?m)", 4) == 0)
+        {
+            flags |= RE_MULTILINE;
+        }
+        else
+        {
             break;
         }
+    }
 
-        // case when group is not the last element in variation?
-        if (groupLastElement != 0 && !isVariation)
+    re_regex *reg = (re_regex *)calloc(1, sizeof(re_regex));
+    reg->states = (re_state *)calloc(MAX_PATTERN_LENGTH + 1, sizeof(re_state));
+    reg->states[0].type = RE_FIRST; // flag for beginning
+    reg->flags = flags;
+    if (flags & RE_LOCALE)
+    {
+        // the locale is read once, matching doesn't depend on it
+        for (int c = 0; c < 256; c++)
         {
-            for (size_t k = 0; k < groupLastElement; k++)
-            {
-                reg.nfa[groupLastElements[k]][groupLastElements[groupLastElement - 1] + 1] = 1; // column
-
-                if (!neighbourVariation)
-                {
-                    reg.nfa[groupFirstElements[0] - 1][groupFirstElements[k]] = 1; // row
-                }
-                else
-                {
-                    for (size_t l = 0; l < lastOutputLength; l++)
-                    {
-                        reg.nfa[lastOutput[l]][groupFirstElements[k]] = 1;
-                    }
-                }
-            }
-
-            for (size_t k = 0; k < groupLastElement; k++)
-            {
-                lastOutput[k] = groupLastElements[k];
-                neighbourVariation = true;
-            }
-            lastOutputLength = groupLastElement != 0 ? groupLastElement : 0;
-
-            groupFirstElement = 0;
-            groupLastElement = 0;
+            reg->classes[c] = (isdigit(c) ? RE_CLASS_DIGIT : 0) | (isspace(c) ? RE_CLASS_SPACE : 0) | (isalnum(c) ? RE_CLASS_WORD : 0);
         }
-        else if (!isVariation && groupFirstElement == 0) // non-group straight case
+    }
+    else
+    {
+        memcpy(reg->classes, asciiClasses, sizeof(asciiClasses));
+    }
+    // the pattern is parsed into a tree, which is simplified and turned into states
+    re_parser p;
+    memset(&p, 0, sizeof(re_parser));
+    p.pattern = pattern;
+    p.length = strlen(pattern);
+    p.utf8 = flags & RE_UTF8;
+    p.multiline = flags & RE_MULTILINE;
+
+    int root = parseAlternation(&p);
+    if (!p.error && pattern[p.i] != '\0')
+    {
+        p.error = true; // ')' without '('
+    }
+    re_positions whole;
+    if (!p.error)
+    {
+        root = optimizeNode(&p, root);
+        if (p.groups > 0)
         {
-            reg.nfa[j - 1][j] = 1;
-            neighbourVariation = false;
+            // the depths are recorded, while the states are connected
+            reg->edgeDepth = (short(*)[MAX_PATTERN_LENGTH])calloc(MAX_PATTERN_LENGTH, sizeof(*reg->edgeDepth));
         }
+        reg->memberOffsets = (int *)calloc(MAX_PATTERN_LENGTH + 1, sizeof(int));
+        reg->skipOffsets = (int *)calloc(2, sizeof(int));
+        reg->skipCount = 1;
+        p.error = !buildStates(reg, &p, root, 0, &whole) || p.error;
+    }
+    free(p.nodes);
+    if (p.error)
+    {
+        re_free((re *)&reg);
+        return 0;
+    }
 
-        ++i;
-        ++j;
+    reg->groups = p.groups;
+    for (int k = 1; k <= reg->size; k++)
+    {
+        reg->nfa[0][k] = whole.first[k];
+        if (reg->edgeDepth != NULL)
+        {
+            reg->edgeDepth[0][k] = -1; // the match enters all groups of the first state
+        }
+        reg->finals[k] = whole.last[k];
+        setSkips(reg, 0, k, whole.first[k] ? whole.firstSkips[k] : 0);
+        setSkips(reg, k, 0, whole.last[k] ? whole.lastSkips[k] : 0);
     }
+    reg->finals[0] = whole.nullable;
+    setSkips(reg, 0, 0, whole.emptySkips);
+    reg->states[reg->size + 1].type = RE_LAST;
 
-    reg.size = j - 1;
+    // byte automata and its reversed copy for the two pass search
+    reg->forward = buildAutomata(reg, false);
+    reg->backward = buildAutomata(reg, true);
+    findPrefix(reg);
+    analyzeAutomata(reg);
 
-    reg.states[j].type = LAST;
+    // a match, that starts with ^, can start only at the first byte, so no threads are started later
+    unsigned char kind = reg->anchoring == RE_ANCHOR_TEXT ? RE_DFA_ANCHORED : 0;
+    reg->search = createDfa(reg->forward, RE_DFA_LEFTMOST | kind);
+    reg->reverse = createDfa(reg->backward, RE_DFA_ANCHORED);
+    reg->anchored = createDfa(reg->forward, RE_DFA_ANCHORED);
+    reg->earliest = createDfa(reg->forward, kind);
+    analyzeGroups(reg, p.ambiguous);
+    planMatching(reg);
 
-    return (re)&reg;
+    return (re)reg;
+}
+
+static void printSymbol(const char *name, unsigned int symbol)
+{
+    if (symbol < 0x80)
+    {
+        printf("\t\t%s: %c\n", name, symbol);
+    }
+    else
+    {
+        printf("\t\t%s: U+%04X\n", name, symbol);
+    }
 }
 
 void re_print(re *pattern)
@@ -849,7 +1030,7 @@ void re_print(re *pattern)
         {
             printf("%d ", (*pattern)->nfa[i][k]);
         }
-        printf("\n");
+        printf((*pattern)->finals[i] ? "final\n" : "\n");
     }
 
     const char *types[] = {
@@ -860,33 +1041,34 @@ void re_print(re *pattern)
         "RANGE",
         "SYMBOL",
         "DOT",
-        "NUMERIC",        // \d
-        "NONNUMERIC",     // \D
-        "SPACE",          // \s
-        "NONSPACE",       // \S
-        "ALPHANUMERIC",   // \w
-        "NONALPHANUMERIC" // \W
+        "NUMERIC",         // \d
+        "NONNUMERIC",      // \D
+        "SPACE",           // \s
+        "NONSPACE",        // \S
+        "ALPHANUMERIC",    // \w
+        "NONALPHANUMERIC", // \W
+        "ASSERTION"        // ^, $, \b, \B
     };
 
     int i = 1;
     printf("\n\tStates:\n");
-    while ((*pattern)->states[i].type != LAST)
+    while ((*pattern)->states[i].type != RE_LAST)
     {
         printf("%d\n\ttype: %s\n", i, types[(*pattern)->states[i].type]);
         printf("\tElements in class:\n");
 
         int j = 0;
-        while ((*pattern)->states[i].symbols[j].type != LAST)
+        while ((*pattern)->states[i].symbols[j].type != RE_LAST)
         {
             printf("\ti: %d\n\t\ttype: %s\n", j, types[(*pattern)->states[i].symbols[j].type]);
-            if ((*pattern)->states[i].symbols[j].type == SYMBOL || (*pattern)->states[i].symbols[j].type == DOT || (*pattern)->states[i].symbols[j].type == SPACE || (*pattern)->states[i].symbols[j].type == NONSPACE || (*pattern)->states[i].symbols[j].type == NUMERIC || (*pattern)->states[i].symbols[j].type == NONNUMERIC || (*pattern)->states[i].symbols[j].type == ALPHANUMERIC || (*pattern)->states[i].symbols[j].type == NONALPHANUMERIC)
+            if ((*pattern)->states[i].symbols[j].type == RE_SYMBOL || (*pattern)->states[i].symbols[j].type == RE_DOT || (*pattern)->states[i].symbols[j].type == RE_SPACE || (*pattern)->states[i].symbols[j].type == RE_NONSPACE || (*pattern)->states[i].symbols[j].type == RE_NUMERIC || (*pattern)->states[i].symbols[j].type == RE_NONNUMERIC || (*pattern)->states[i].symbols[j].type == RE_ALPHANUMERIC || (*pattern)->states[i].symbols[j].type == RE_NONALPHANUMERIC || (*pattern)->states[i].symbols[j].type == RE_ASSERTION)
             {
-                printf("\t\tvalue: %c\n", (*pattern)->states[i].symbols[j].value.element);
+                printSymbol("value", (*pattern)->states[i].symbols[j].value.element);
             }
-            else //if ((*pattern)->states[i].symbols[j].type == RANGE)
+            else //if ((*pattern)->states[i].symbols[j].type == RE_RANGE)
             {
-                printf("\t\tstart: %c\n", (*pattern)->states[i].symbols[j].value.rng.start);
-                printf("\t\tfinish: %c\n", (*pattern)->states[i].symbols[j].value.rng.finish);
+                printSymbol("start", (*pattern)->states[i].symbols[j].value.rng.start);
+                printSymbol("finish", (*pattern)->states[i].symbols[j].value.rng.finish);
             }
 
             ++j;
@@ -897,201 +1079,3933 @@ void re_print(re *pattern)
     }
 }
 
-bool re_match(re *pattern, const char *string)
+static void printDfa(const char *name, re_dfa *d)
 {
-    int i = 0;            // index in string
-    int j = 0, prevj = 0; // row in nfa
+    printf("dfa %s: %d states, %zu bytes, %u flushes\n", name, d->count, d->memory, d->flushes);
+}
+
+void re_explain(re *pattern)
+{
+    re_regex *reg = *pattern;
+    const char *prefilters[] = {"none", "literal prefix", "first bytes", "line starts"};
+    const char *anchorings[] = {"", ", anchored at the start of the string", ", anchored at the starts of lines"};
+    const char *engines[] = {"two pass lazy dfa", "literal scan"};
+    const char *capturing[] = {"none", "one pass", "thread list"};
+
+    printf("pattern: %d states, %d groups%s%s\n", reg->size, reg->groups,
+           reg->flags & RE_UTF8 ? ", utf-8" : "", reg->flags & RE_ICASE ? ", case insensitive" : "");
+    if (reg->maxLength == RE_UNBOUNDED)
+    {
+        printf("match length: %zu .. unbounded\n", reg->minLength);
+    }
+    else
+    {
+        printf("match length: %zu .. %zu\n", reg->minLength, reg->maxLength);
+    }
 
-    bool matches = true;
-    while (matches && j < (*pattern)->size && i < strlen(string))
+    printf("prefilter: %s", prefilters[reg->prefilter]);
+    if (reg->prefilter == RE_PREFILTER_PREFIX)
     {
-        for (int k = j + 1; k < (*pattern)->size + 1; k++)
+        printf(" \"%.*s\"%s", reg->prefixLength, reg->prefix, reg->prefixFolded ? " ignoring case" : "");
+    }
+    else if (reg->prefilter == RE_PREFILTER_FIRST_BYTES)
+    {
+        int count = 0;
+        for (int c = 0; c < 256; c++)
         {
+            count += reg->firstBytes[c] != 0;
+        }
+        printf(", %d of 256 bytes can start a match", count);
+    }
+    printf("\nsearch: %s%s\ncaptures: %s\n", engines[reg->engine], anchorings[reg->anchoring], capturing[reg->capturing]);
 
-            int s = 0;
-            if ((*pattern)->nfa[j][k])
-            {
-                // minimal number of state entries
-                if ((*pattern)->states[k].min > 0)
-                {
-                    while (s < (*pattern)->states[k].min && matchState(&(*pattern)->states[k], string[i]))
-                    {
-                        ++s;
-                        ++i;
-                    }
-                }
-                if (s < (*pattern)->states[k].min)
-                {
-                    if (s == 0 && k == (*pattern)->size)
-                    {
-                        return false;
-                    }
-                    continue;
-                }
+    size_t memory = sizeof(re_regex) + (MAX_PATTERN_LENGTH + 1) * (sizeof(re_state) + sizeof(int)) +
+                    reg->memberOffsets[reg->size + 1] * sizeof(re_membership) + reg->forward->size;
+    printf("byte automata: %d nodes, %d transitions, %d byte sets, %d byte classes\n",
+           reg->forward->size, reg->forward->offsets[reg->forward->size], reg->forward->setsCount, reg->forward->width - 1);
+    memory += automataFootprint(reg->forward) + automataFootprint(reg->backward);
+    re_dfa *dfas[] = {reg->search, reg->reverse, reg->anchored, reg->earliest};
+    const char *names[] = {"search", "reverse", "anchored", "earliest"};
+    for (int i = 0; i < 4; i++)
+    {
+        printDfa(names[i], dfas[i]);
+        memory += dfas[i]->memory;
+    }
+    if (reg->edgeDepth != NULL)
+    {
+        memory += MAX_PATTERN_LENGTH * sizeof(*reg->edgeDepth);
+    }
+    if (reg->skips != NULL)
+    {
+        memory += MAX_PATTERN_LENGTH * sizeof(*reg->skips);
+    }
+    memory += (reg->skipCount + 1 + reg->skipOffsets[reg->skipCount]) * sizeof(int);
+    if (reg->bytes != NULL)
+    {
+        memory += (reg->size + 1) * sizeof(*reg->bytes);
+    }
+    if (reg->rangeOffsets != NULL)
+    {
+        memory += (reg->size + 2) * sizeof(int) + reg->rangeOffsets[reg->size + 1] * sizeof(re_range);
+    }
+    if (reg->successors != NULL)
+    {
+        printf("one pass table: %d rows\n", reg->size + 1);
+        memory += (reg->size + 1) * sizeof(*reg->successors);
+    }
+    printf("memory: %zu bytes\n", memory);
+}
 
-                while (s < (*pattern)->states[k].max && string[i] != '\0' && matchState(&(*pattern)->states[k], string[i])) // && i < strlen(string)
-                {
-                    ++s;
-                    ++i;
-                }
+/*
+    Applies the memory limit of options to all dfa caches and returns the step budget.
 
-                if (s >= (*pattern)->states[k].min)
-                {
-                    prevj = j;
-                    j = k;
-                    break;
-                }
+Caches, that are larger than the limit, are flushed and shrunk to it.
+*/
+static size_t applyOptions(re_regex *reg, const re_options *options)
+{
+    size_t limit = options != NULL && options->maxMemory ? options->maxMemory : MAX_DFA_MEMORY;
+    re_dfa *dfas[] = {reg->search, reg->reverse, reg->anchored, reg->earliest};
+    for (int i = 0; i < 4; i++)
+    {
+        dfas[i]->limit = limit;
+        if (dfas[i]->memory > limit)
+        {
+            dfaFlush(dfas[i]);
+        }
+    }
 
-            }
+    return options != NULL && options->maxSteps ? options->maxSteps : (size_t)-1;
+}
+
+static int fullMatch(re_regex *reg, const unsigned char *text, size_t budget)
+{
+    if (reg->engine == RE_ENGINE_LITERAL)
+    {
+        size_t length = strlen((const char *)text);
+        return length == (size_t)reg->prefixLength && scanPrefix(reg, text, text + length) == text;
+    }
+
+    re_dfa *d = reg->anchored;
+    int s = dfaStart(d, -1);
+    for (; s >= 0 && *text != '\0'; text++)
+    {
+        if (budget-- == 0)
+        {
+            return RE_BUDGET_EXCEEDED;
         }
 
-        if (prevj == j)
+        RE_STATS_STEP(reg);
+        s = dfaNext(d, s, *text);
+        if (s >= 0 && d->flags[s] & RE_STATE_DEAD) // the rest of the string can't be matched
         {
             return false;
         }
     }
-
-    // compute sum on j`th row
-    // if it equals to 0, than it is the last element in regular expression
-    int outcome = 0;
-    for (size_t k = 0; k < (*pattern)->size + 1; k++)
+    if (s >= 0)
     {
-        outcome += (*pattern)->nfa[j][k];
+        s = dfaNext(d, s, RE_END_OF_INPUT);
     }
 
-    return i == strlen(string) && outcome == 0;
+    return s < 0 ? RE_BUDGET_EXCEEDED : (d->flags[s] & RE_STATE_MATCH) != 0;
 }
-bool re_matchp(const char *pattern, const char *string)
+bool re_match(re *pattern, const char *string)
 {
-    re p = re_compile(pattern);
+    RE_STATS_BEGIN(*pattern);
+    bool matches = fullMatch(*pattern, (const unsigned char *)string, applyOptions(*pattern, NULL)) == true;
+    RE_STATS_END(*pattern, matches);
 
-    return re_match(&p, string);
+    return matches;
+}
+bool re_matchp(const char *pattern, const char *string)
+{
+    re p = re_compile(pattern);
+    if (p == NULL)
+    {
+        return false;
+    }
+
+    bool matches = re_match(&p, string);
+    re_free(&p);
+    return matches;
 }
 
 int re_find(re *pattern, const char *string)
 {
-    for (size_t st = 0; st < strlen(string); st++)
+    return re_findspan(pattern, string, strlen(string), NULL);
+}
+int re_findp(const char *pattern, const char *string)
+{
+    re p = re_compile(pattern);
+    if (p == NULL)
     {
-        int i = 0;            // index in string
-        int j = 0, prevj = 0; // row in nfa
+        return -1;
+    }
+
+    int start = re_find(&p, string);
+    re_free(&p);
+    return start;
+}
+
+/*
+    Runs the forward pass of the search from the checkpoint, until it finishes or reaches stop.
 
-        bool matches = true;
-        while (matches && j < (*pattern)->size && i + st < strlen(string))
+The earliest started thread is followed until it dies, so the last match seen is the end
+of the leftmost-longest match. The checkpoint is updated to the place, where the pass stopped.
+
+Returns RE_PASS_FINISHED, RE_PASS_PAUSED at stop or RE_BUDGET_EXCEEDED.
+*/
+static int forwardPass(re_regex *reg, const unsigned char *text, size_t length, size_t stop, size_t *budget, re_checkpoint *at)
+{
+    re_dfa *d = reg->search;
+    int s = at->state, t;
+    size_t i = at->position;
+    for (; i < stop; i++)
+    {
+        if (d->flags[s] & RE_STATE_START && reg->prefilter != RE_PREFILTER_NONE)
         {
-            for (int k = j + 1; k < (*pattern)->size + 1; k++)
+            // no thread is alive, so offsets, where the match can't start, are skipped,
+            // the scan looks only as far as a match, that starts before stop, can reach
+            size_t window = length - stop > reg->minLength ? stop + reg->minLength : length;
+            size_t skipped = skipStart(reg, text, i, window);
+            RE_STATS_PREFILTER(reg, skipped < window, skipped - i);
+            if (skipped == length)
             {
-                if ((*pattern)->nfa[j][k])
+                at->position = length;
+                at->horizon = length + 1; // the rest of the text is seen up to its end
+                return RE_PASS_FINISHED;
+            }
+            if (skipped == window)
+            {
+                i = stop;
+                s = dfaStart(d, text[stop - 1]);
+                at->horizon = at->horizon > window ? at->horizon : window;
+                if (s < 0)
                 {
-                    int s = 0;
-                    // minimal number of state entries
-                    if ((*pattern)->states[k].min > 0)
-                    {
-                        while (s < (*pattern)->states[k].min && matchState(&(*pattern)->states[k], string[st + i]))
-                        {
-                            ++s;
-                            ++i;
-                        }
-                    }
-                    if (s < (*pattern)->states[k].min)
-                    {
-                        matches = false;
-
-                        continue;
-                    }
-
-                    while (s < (*pattern)->states[k].max && string[st + i] != '\0' && matchState(&(*pattern)->states[k], string[st + i])) // && i < strlen(string)
-                    {
-                        ++s;
-                        ++i;
-                    }
-
-                    prevj = j;
-                    j = k;
+                    return RE_BUDGET_EXCEEDED;
                 }
+                break;
             }
-
-            // hmmm, it`s useless
-            if (prevj == j || !matches)
+            if (reg->prefilter == RE_PREFILTER_PREFIX && skipped + reg->prefixLength > at->horizon)
             {
-                matches = false;
+                at->horizon = skipped + reg->prefixLength;
+            }
+            if (skipped > i)
+            {
+                i = skipped;
+                s = dfaStart(d, text[skipped - 1]); // assertions see the byte before the new start
+                if (s < 0)
+                {
+                    return RE_BUDGET_EXCEEDED;
+                }
             }
         }
+        if ((*budget)-- == 0)
+        {
+            return RE_BUDGET_EXCEEDED;
+        }
 
-        // compute sum on j`th row
-        // if it equals to 0, than it is the last element in regular expression
-        int outcome = 0;
-        for (size_t k = 0; k < (*pattern)->size + 1; k++)
+        RE_STATS_STEP(reg);
+        t = dfaNext(d, s, text[i]);
+        if (t < 0)
+        {
+            return RE_BUDGET_EXCEEDED;
+        }
+        if (d->flags[t] & RE_STATE_MATCH)
+        {
+            at->last = i;
+        }
+        if (d->flags[t] & RE_STATE_DEAD)
+        {
+            at->position = i + 1;
+            at->horizon = at->horizon > i + 1 ? at->horizon : i + 1;
+            return RE_PASS_FINISHED;
+        }
+        s = t;
+    }
+
+    at->state = s;
+    at->position = i;
+    if (i < length)
+    {
+        at->horizon = at->horizon > i ? at->horizon : i;
+        return RE_PASS_PAUSED;
+    }
+    t = dfaNext(d, s, RE_END_OF_INPUT);
+    if (t < 0)
+    {
+        return RE_BUDGET_EXCEEDED;
+    }
+    if (d->flags[t] & RE_STATE_MATCH)
+    {
+        at->last = length;
+    }
+    at->horizon = length + 1;
+    return RE_PASS_FINISHED;
+}
+
+/*
+    Runs the backward pass of the search: the longest match of the reversed automata, that ends at last
+and starts at from or later.
+
+Returns the start of the match or RE_BUDGET_EXCEEDED.
+*/
+static int backwardPass(re_regex *reg, const unsigned char *text, size_t length, size_t from, int last, size_t *budget)
+{
+    re_dfa *d = reg->reverse;
+    int s = dfaStart(d, (size_t)last < length ? text[last] : -1), t = s;
+    int first = last;
+    int i = last;
+    for (; s >= 0 && i > (int)from; i--)
+    {
+        if ((*budget)-- == 0)
         {
-            outcome += (*pattern)->nfa[j][k];
+            return RE_BUDGET_EXCEEDED;
         }
 
-        if (outcome == 0)
+        RE_STATS_STEP(reg);
+        t = dfaNext(d, s, text[i - 1]);
+        if (t < 0)
+        {
+            return RE_BUDGET_EXCEEDED;
+        }
+        if (d->flags[t] & RE_STATE_MATCH)
+        {
+            first = i;
+        }
+        if (d->flags[t] & RE_STATE_DEAD)
         {
-            return st;
+            break;
+        }
+        s = t;
+    }
+    if (t >= 0 && i == (int)from)
+    {
+        // the byte before from isn't matched, but assertions see it
+        t = dfaNext(d, s, from > 0 ? text[from - 1] : RE_END_OF_INPUT);
+        if (t >= 0 && d->flags[t] & RE_STATE_MATCH)
+        {
+            first = (int)from;
         }
     }
+    return t < 0 ? RE_BUDGET_EXCEEDED : first;
+}
 
-    return -1;
+static int findSpan(re_regex *reg, const unsigned char *text, size_t from, size_t length, size_t *budget, int *end)
+{
+    if (length - from < reg->minLength)
+    {
+        return RE_NOMATCH;
+    }
+    if (reg->engine == RE_ENGINE_LITERAL)
+    {
+        const unsigned char *found = scanPrefix(reg, text + from, text + length);
+        RE_STATS_PREFILTER(reg, found != NULL, length - from);
+        if (found == NULL)
+        {
+            return RE_NOMATCH;
+        }
+        if (end != NULL)
+        {
+            *end = (int)(found - text) + reg->prefixLength;
+        }
+        return (int)(found - text);
+    }
+
+    re_checkpoint at = {from, dfaStart(reg->search, from > 0 ? text[from - 1] : -1), RE_NOMATCH, from, 0};
+    if (at.state < 0 || forwardPass(reg, text, length, length, budget, &at) < 0)
+    {
+        return RE_BUDGET_EXCEEDED;
+    }
+    if (at.last < 0)
+    {
+        return RE_NOMATCH;
+    }
+
+    int first = backwardPass(reg, text, length, from, at.last, budget);
+    if (first >= 0 && end != NULL)
+    {
+        *end = at.last;
+    }
+    return first;
 }
-int re_findp(const char *pattern, const char *string)
+int re_search(re *pattern, const char *string, size_t length, const re_options *options, int *end)
 {
-    re p = re_compile(pattern);
+    return re_search_from(pattern, string, length, 0, options, end);
+}
+int re_search_from(re *pattern, const char *string, size_t length, size_t from, const re_options *options, int *end)
+{
+    if (length > INT_MAX)
+    {
+        return RE_TOO_LONG;
+    }
+    if (from > length)
+    {
+        return RE_NOMATCH;
+    }
+    RE_STATS_BEGIN(*pattern);
+    size_t budget = applyOptions(*pattern, options);
+    int start = findSpan(*pattern, (const unsigned char *)string, from, length, &budget, end);
+    RE_STATS_END(*pattern, start >= 0);
 
-    return re_find(&p, string);
+    return start;
+}
+int re_findspan(re *pattern, const char *string, size_t length, int *end)
+{
+    return re_search(pattern, string, length, NULL, end);
 }
 
-bool matchState(state *st, const char c)
+static int earliestMatch(re_regex *reg, const unsigned char *text, size_t length, size_t budget)
 {
-    bool matches = false;
+    if (length < reg->minLength)
+    {
+        return false;
+    }
+    if (reg->engine == RE_ENGINE_LITERAL)
+    {
+        bool found = scanPrefix(reg, text, text + length) != NULL;
+        RE_STATS_PREFILTER(reg, found, length);
+        return found;
+    }
 
-    int i = 0;
-    while (!matches && st->symbols[i].type != LAST)
+    re_dfa *d = reg->earliest;
+    int s = dfaStart(d, -1);
+    for (size_t i = 0; s >= 0 && i < length; i++)
     {
+        if (d->flags[s] & RE_STATE_START && reg->prefilter != RE_PREFILTER_NONE)
+        {
+            size_t skipped = skipStart(reg, text, i, length);
+            RE_STATS_PREFILTER(reg, skipped < length, skipped - i);
+            if (skipped == length)
+            {
+                return false;
+            }
+            if (skipped > i)
+            {
+                i = skipped;
+                s = dfaStart(d, text[skipped - 1]);
+                if (s < 0)
+                {
+                    break;
+                }
+            }
+        }
+        if (budget-- == 0)
+        {
+            return RE_BUDGET_EXCEEDED;
+        }
 
-        if (st->symbols[i].type == DOT)
+        RE_STATS_STEP(reg);
+        s = dfaNext(d, s, text[i]);
+        if (s >= 0 && d->flags[s] & RE_STATE_MATCH)
         {
-            matches = isascii(c);
+            return true;
         }
-        else if (st->symbols[i].type == SYMBOL)
+        if (s >= 0 && d->flags[s] & RE_STATE_DEAD)
         {
-            matches = c == (*st).symbols[i].value.element;
+            return false;
+        }
+    }
+    if (s >= 0)
+    {
+        s = dfaNext(d, s, RE_END_OF_INPUT);
+    }
+
+    return s < 0 ? RE_BUDGET_EXCEEDED : (d->flags[s] & RE_STATE_MATCH) != 0;
+}
+int re_test(re *pattern, const char *string, size_t length, const re_options *options)
+{
+    RE_STATS_BEGIN(*pattern);
+    int matches = earliestMatch(*pattern, (const unsigned char *)string, length, applyOptions(*pattern, options));
+    RE_STATS_END(*pattern, matches == true);
+
+    return matches;
+}
+bool re_is_match(re *pattern, const char *string, size_t length)
+{
+    return re_test(pattern, string, length, NULL) == true;
+}
+
+void re_info(re *pattern, re_properties *info)
+{
+    info->minLength = (*pattern)->minLength;
+    info->maxLength = (*pattern)->maxLength;
+    memset(info->firstBytes, 0, sizeof(info->firstBytes));
+    for (int c = 0; c < 256; c++)
+    {
+        info->firstBytes[c >> 3] |= (*pattern)->firstBytes[c] << (c & 7);
+    }
+    info->prefixLength = (*pattern)->prefixLength;
+    info->literal = (*pattern)->literal;
+}
+
+int re_groups(re *pattern)
+{
+    return (*pattern)->groups;
+}
+
+int re_captures(re *pattern, const char *string, size_t length, const re_options *options, re_span *spans, int count)
+{
+    int end;
+    int start = re_search(pattern, string, length, options, &end);
+    if (start < 0)
+    {
+        return start;
+    }
+
+    re_regex *reg = *pattern;
+    int *captures = (int *)malloc(2 * (reg->groups + 1) * sizeof(int));
+    findCaptures(reg, (const unsigned char *)string, length, start, end, captures);
+
+    for (int g = 0; g < count; g++)
+    {
+        bool taken = g <= reg->groups && captures[2 * g] >= 0 && captures[2 * g + 1] >= 0;
+        spans[g].start = taken ? captures[2 * g] : -1;
+        spans[g].end = taken ? captures[2 * g + 1] : -1;
+    }
+    free(captures);
+    return start;
+}
+
+/*
+    Result of the replacement: a fixed buffer, that keeps what fits, or a growable one.
+*/
+typedef struct re_output
+{
+    char **buffer;
+    size_t *capacity;
+    size_t length; // length of the whole result, even if it doesn't fit
+    bool growable;
+} re_output;
+
+static void appendOutput(re_output *o, const char *bytes, size_t count)
+{
+    if (o->growable && o->length + count + 1 > *o->capacity)
+    {
+        size_t capacity = *o->capacity > 0 ? *o->capacity : 64;
+        while (capacity < o->length + count + 1)
+        {
+            capacity *= 2;
+        }
+        *o->buffer = (char *)realloc(*o->buffer, capacity);
+        *o->capacity = capacity;
+    }
+    if (o->length + 1 < *o->capacity)
+    {
+        size_t fits = *o->capacity - 1 - o->length;
+        memcpy(*o->buffer + o->length, bytes, count < fits ? count : fits);
+    }
+    o->length += count;
+}
+
+/*
+    Returns the number of the group after '$' and moves i after the reference, or -1 for a plain '$'.
+*/
+static int groupReference(const char *replacement, size_t *i)
+{
+    size_t k = *i + 1;
+    if (isdigit((unsigned char)replacement[k]))
+    {
+        *i = k + 1;
+        return replacement[k] - '0';
+    }
+    if (replacement[k] != '{' || !isdigit((unsigned char)replacement[k + 1]))
+    {
+        return -1;
+    }
+
+    int group = 0;
+    for (++k; isdigit((unsigned char)replacement[k]) && group < MAX_PATTERN_LENGTH; k++)
+    {
+        group = group * 10 + replacement[k] - '0';
+    }
+    if (replacement[k] != '}')
+    {
+        return -1;
+    }
+    *i = k + 1;
+    return group;
+}
+
+/*
+    Writes the replacement of the match [start, end).
+
+Arguments:
+captures - captures of the match, NULL if the replacement doesn't refer to groups
+*/
+static void expandReplacement(re_output *o, const char *replacement, const char *string, re_regex *reg, const int *captures, int start, int end)
+{
+    size_t i = 0, copied = 0;
+    while (replacement[i] != '\0')
+    {
+        if (replacement[i] != '$')
+        {
+            ++i;
+            continue;
         }
-        else if (st->symbols[i].type == RANGE)
+        if (replacement[i + 1] == '$')
         {
-            matches = (*st).symbols[i].value.rng.start <= c && (*st).symbols[i].value.rng.finish >= c;
+            appendOutput(o, replacement + copied, i + 1 - copied);
+            i += 2;
+            copied = i;
+            continue;
         }
-        else
+
+        size_t reference = i;
+        int group = groupReference(replacement, &i);
+        if (group < 0)
         {
-            switch ((*st).symbols[i].type)
+            ++i; // the '$' is kept as it is
+            continue;
+        }
+        appendOutput(o, replacement + copied, reference - copied);
+        if (group == 0)
+        {
+            appendOutput(o, string + start, end - start);
+        }
+        else if (group <= reg->groups && captures[2 * group] >= 0 && captures[2 * group + 1] >= 0)
+        {
+            appendOutput(o, string + captures[2 * group], captures[2 * group + 1] - captures[2 * group]);
+        }
+        copied = i;
+    }
+    appendOutput(o, replacement + copied, i - copied);
+}
+
+/*
+    Replaces the first or every match in a single scan, text between matches is copied as it is.
+*/
+static int replaceMatches(re_regex *reg, const char *string, size_t length, const char *replacement, bool all, const re_options *options, re_output *o)
+{
+    if (length > INT_MAX)
+    {
+        return RE_TOO_LONG;
+    }
+    RE_STATS_BEGIN(reg);
+    // captures are found only for replacements, that refer to groups
+    int *captures = NULL;
+    for (size_t i = 0; replacement[i] != '\0' && captures == NULL; i++)
+    {
+        size_t k = i;
+        if (replacement[i] == '$' && groupReference(replacement, &k) > 0)
+        {
+            captures = (int *)malloc(2 * (reg->groups + 1) * sizeof(int));
+        }
+    }
+
+    const unsigned char *text = (const unsigned char *)string;
+    size_t budget = applyOptions(reg, options);
+    size_t from = 0, copied = 0;
+    int found = RE_NOMATCH;
+    while (from <= length)
+    {
+        int end;
+        found = findSpan(reg, text, from, length, &budget, &end);
+        if (found < 0)
+        {
+            break;
+        }
+        size_t start = found;
+        appendOutput(o, string + copied, start - copied);
+        if (captures != NULL)
+        {
+            findCaptures(reg, text, length, start, end, captures);
+        }
+        expandReplacement(o, replacement, string, reg, captures, start, end);
+        copied = end;
+        if (!all)
+        {
+            break;
+        }
+
+        if (start == (size_t)end)
+        {
+            // an empty match can't repeat at the same place, the next symbol is kept
+            if (copied == length)
             {
-            case NUMERIC:
-                matches = isdigit(c);
-                break;
-            case NONNUMERIC:
-                matches = !isdigit(c);
-                break;
-            case SPACE:
-                matches = isspace(c);
-                break;
-            case NONSPACE:
-                matches = !isspace(c);
-                break;
-            case ALPHANUMERIC:
-                matches = isalnum(c);
-                break;
-            case NONALPHANUMERIC:
-                matches = !isalnum(c);
                 break;
+            }
+            unsigned int symbolLength;
+            readSymbol(string + copied, length - copied, reg->flags & RE_UTF8, &symbolLength);
+            appendOutput(o, string + copied, symbolLength);
+            copied += symbolLength;
+        }
+        from = copied;
+    }
+    free(captures);
+    RE_STATS_END(reg, copied > 0 || found >= 0); // copied stays 0 only without matches or after an empty one
+    if (found == RE_BUDGET_EXCEEDED)
+    {
+        return RE_BUDGET_EXCEEDED;
+    }
 
-            default:
+    appendOutput(o, string + copied, length - copied);
+    if (*o->capacity > 0)
+    {
+        size_t last = o->length < *o->capacity - 1 ? o->length : *o->capacity - 1;
+        (*o->buffer)[last] = '\0';
+    }
+    return o->length > INT_MAX ? RE_TOO_LONG : (int)o->length;
+}
+int re_replace(re *pattern, const char *string, size_t length, const char *replacement, const re_options *options, char *out, size_t capacity)
+{
+    re_output o = {&out, &capacity, 0, false};
+    return replaceMatches(*pattern, string, length, replacement, false, options, &o);
+}
+int re_replace_all(re *pattern, const char *string, size_t length, const char *replacement, const re_options *options, char *out, size_t capacity)
+{
+    re_output o = {&out, &capacity, 0, false};
+    return replaceMatches(*pattern, string, length, replacement, true, options, &o);
+}
+int re_replace_buffer(re *pattern, const char *string, size_t length, const char *replacement, bool all, const re_options *options, char **buffer, size_t *capacity)
+{
+    if (*buffer == NULL)
+    {
+        *capacity = 0;
+    }
+    re_output o = {buffer, capacity, 0, true};
+    appendOutput(&o, "", 0); // the result is terminated even if it is empty
+    return replaceMatches(*pattern, string, length, replacement, all, options, &o);
+}
+
+/*
+    Splits string by matches of the pattern and hands fields to the callback or stores them in fields.
+*/
+static int splitFields(re_regex *reg, const char *string, size_t length, const re_options *options, re_span *fields, int count, re_split_callback callback, void *context)
+{
+    if (length > INT_MAX)
+    {
+        return RE_TOO_LONG;
+    }
+    if (callback == NULL && count <= 0)
+    {
+        return 0;
+    }
+
+    RE_STATS_BEGIN(reg);
+    const unsigned char *text = (const unsigned char *)string;
+    size_t budget = applyOptions(reg, options);
+    size_t fieldStart = 0, from = 0;
+    int produced = 0;
+    bool stopped = false;
+    // with the array the last field takes the rest of the string
+    while (!stopped && from <= length && (callback != NULL || produced < count - 1))
+    {
+        int end;
+        int found = findSpan(reg, text, from, length, &budget, &end);
+        if (found == RE_BUDGET_EXCEEDED)
+        {
+            RE_STATS_END(reg, produced > 0);
+            return RE_BUDGET_EXCEEDED;
+        }
+        if (found < 0)
+        {
+            break;
+        }
+        size_t start = found;
+        if (start == (size_t)end && (start == fieldStart || start == length))
+        {
+            // an empty match separates symbols, but it doesn't make empty fields
+            if (start == length)
+            {
                 break;
             }
+            unsigned int symbolLength;
+            readSymbol(string + start, length - start, reg->flags & RE_UTF8, &symbolLength);
+            from = start + symbolLength;
+            continue;
         }
 
-        ++i;
+        if (callback != NULL)
+        {
+            stopped = !callback(string + fieldStart, start - fieldStart, context);
+        }
+        else
+        {
+            fields[produced].start = (int)fieldStart;
+            fields[produced].end = (int)start;
+        }
+        ++produced;
+        fieldStart = from = end;
+    }
+    RE_STATS_END(reg, produced > 0);
+    if (stopped)
+    {
+        return produced;
     }
 
-    return ((*st).type == REGULAR) == matches;
+    if (callback != NULL)
+    {
+        callback(string + fieldStart, length - fieldStart, context);
+    }
+    else
+    {
+        fields[produced].start = (int)fieldStart;
+        fields[produced].end = (int)length;
+    }
+    return produced + 1;
+}
+int re_split(re *pattern, const char *string, size_t length, const re_options *options, re_span *fields, int count)
+{
+    return splitFields(*pattern, string, length, options, fields, count, NULL, NULL);
+}
+int re_split_each(re *pattern, const char *string, size_t length, const re_options *options, re_split_callback callback, void *context)
+{
+    return splitFields(*pattern, string, length, options, NULL, 0, callback, context);
+}
+re_stream re_stream_create(re *pattern, size_t interval)
+{
+    re_stream_state *st = (re_stream_state *)calloc(1, sizeof(re_stream_state));
+    st->reg = *pattern;
+    st->interval = interval > 0 ? interval : 4096;
+    return st;
+}
+int re_stream_search(re_stream *handle, const char *buffer, size_t length, size_t unchanged, int *end)
+{
+    if (length > INT_MAX)
+    {
+        return RE_TOO_LONG;
+    }
+    re_stream_state *st = *handle;
+    re_regex *reg = st->reg;
+    re_dfa *d = reg->search;
+    const unsigned char *text = (const unsigned char *)buffer;
+    RE_STATS_BEGIN(reg);
+    size_t budget = applyOptions(reg, NULL);
+    unchanged = unchanged < length ? unchanged : length;
+
+    // the result stands, if the pass had finished before the first changed byte
+    if (!st->cached || st->final.horizon > unchanged)
+    {
+        st->cached = false;
+        while (st->count > 0 && (st->checkpoints[st->count - 1].horizon > unchanged || st->checkpoints[st->count - 1].flushes != d->flushes))
+        {
+            --st->count; // states of older checkpoints are lost with the flush too
+        }
+
+        re_checkpoint at;
+        if (st->count > 0)
+        {
+            at = st->checkpoints[st->count - 1];
+        }
+        else
+        {
+            at.position = 0;
+            at.state = dfaStart(d, -1);
+            at.last = RE_NOMATCH;
+            at.horizon = 0;
+        }
+        int result = at.state < 0 ? RE_BUDGET_EXCEEDED : RE_PASS_PAUSED;
+        while (result == RE_PASS_PAUSED)
+        {
+            size_t stop = at.position + st->interval < length ? at.position + st->interval : length;
+            result = forwardPass(reg, text, length, stop, &budget, &at);
+            if (result == RE_PASS_PAUSED)
+            {
+                at.flushes = d->flushes;
+                if (st->count == st->capacity)
+                {
+                    st->capacity = st->capacity ? st->capacity * 2 : 16;
+                    st->checkpoints = (re_checkpoint *)realloc(st->checkpoints, st->capacity * sizeof(re_checkpoint));
+                }
+                st->checkpoints[st->count++] = at;
+            }
+        }
+
+        st->start = result < 0 ? RE_BUDGET_EXCEEDED : at.last < 0 ? RE_NOMATCH : backwardPass(reg, text, length, 0, at.last, &budget);
+        st->end = at.last;
+        st->final = at;
+        st->cached = st->start != RE_BUDGET_EXCEEDED;
+    }
+
+    if (st->start >= 0 && end != NULL)
+    {
+        *end = st->end;
+    }
+    RE_STATS_END(reg, st->start >= 0);
+    return st->start;
+}
+void re_stream_free(re_stream *handle)
+{
+    if (handle == NULL || *handle == NULL)
+    {
+        return;
+    }
+    free((*handle)->checkpoints);
+    free(*handle);
+    *handle = NULL;
+}
+
+#ifdef CREGEX_STATS
+static unsigned long long statsClock(void)
+{
+    // the monotonic clock is POSIX, strict C11 has only the calendar time and C99 only the processor time
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#elif defined(TIME_UTC)
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#else
+    return (unsigned long long)clock() * (1000000000ull / CLOCKS_PER_SEC);
+#endif
+}
+
+static void statsFinish(re_regex *reg, unsigned long long started, bool matched)
+{
+    unsigned long long elapsed = statsClock() - started;
+    reg->stats.matches += matched;
+    reg->stats.nanoseconds += elapsed;
+    if (reg->slowHook != NULL && elapsed >= reg->slowThreshold)
+    {
+        reg->slowHook(reg, elapsed, reg->slowContext);
+    }
+}
+
+void re_stats_snapshot(re *pattern, re_stats *stats)
+{
+    *stats = (*pattern)->stats;
+
+    // cache misses are counted by the automata themselves
+    re_dfa *automatas[] = {(*pattern)->search, (*pattern)->reverse, (*pattern)->anchored, (*pattern)->earliest};
+    for (size_t i = 0; i < sizeof(automatas) / sizeof(automatas[0]); i++)
+    {
+        stats->cacheMisses += automatas[i]->misses;
+    }
+}
+
+void re_stats_reset(re *pattern)
+{
+    memset(&(*pattern)->stats, 0, sizeof(re_stats));
+    (*pattern)->search->misses = 0;
+    (*pattern)->reverse->misses = 0;
+    (*pattern)->anchored->misses = 0;
+    (*pattern)->earliest->misses = 0;
+}
+
+void re_stats_hook(re *pattern, unsigned long long threshold, re_slow_hook hook, void *context)
+{
+    (*pattern)->slowThreshold = threshold;
+    (*pattern)->slowHook = hook;
+    (*pattern)->slowContext = context;
+}
+#endif
+
+void re_free(re *pattern)
+{
+    if (pattern == NULL || *pattern == NULL)
+    {
+        return;
+    }
+
+    freeDfa((*pattern)->search);
+    freeDfa((*pattern)->reverse);
+    freeDfa((*pattern)->anchored);
+    freeDfa((*pattern)->earliest);
+    freeAutomata((*pattern)->forward);
+    freeAutomata((*pattern)->backward);
+    free((*pattern)->prefix);
+    free((*pattern)->memberOffsets);
+    free((*pattern)->members);
+    free((*pattern)->edgeDepth);
+    free((*pattern)->skips);
+    free((*pattern)->skipOffsets);
+    free((*pattern)->skipGroups);
+    free((*pattern)->bytes);
+    free((*pattern)->rangeOffsets);
+    free((*pattern)->ranges);
+    free((*pattern)->successors);
+    free((*pattern)->states);
+    free(*pattern);
+    *pattern = NULL;
+}
+
+/*
+    Reads one symbol of the pattern: a byte or, in utf-8 mode, a whole encoded codepoint.
+Invalid sequences and sequences, that are cut by the end of the available bytes, are read byte by byte.
+*/
+static unsigned int readSymbol(const char *pattern, size_t available, bool utf8, unsigned int *length)
+{
+    const unsigned char *bytes = (const unsigned char *)pattern;
+    *length = 1;
+    if (!utf8 || bytes[0] < 0xC0 || bytes[0] > 0xF4)
+    {
+        return bytes[0];
+    }
+
+    unsigned int extra = bytes[0] >= 0xF0 ? 3 : bytes[0] >= 0xE0 ? 2 : 1;
+    if (extra >= available)
+    {
+        return bytes[0];
+    }
+    unsigned int codepoint = bytes[0] & (0x3F >> extra);
+    for (unsigned int k = 1; k <= extra; k++)
+    {
+        if ((bytes[k] & 0xC0) != 0x80)
+        {
+            return bytes[0];
+        }
+        codepoint = codepoint << 6 | (bytes[k] & 0x3F);
+    }
+    *length = extra + 1;
+    return codepoint;
+}
+
+/*
+    Appends a node to the tree and returns its index, pointers to nodes are invalidated.
+*/
+static int newNode(re_parser *p, unsigned char kind)
+{
+    if (p->count == p->capacity)
+    {
+        p->capacity = p->capacity ? p->capacity * 2 : 32;
+        p->nodes = (re_node *)realloc(p->nodes, p->capacity * sizeof(re_node));
+    }
+    re_node *n = &p->nodes[p->count];
+    memset(n, 0, sizeof(re_node));
+    n->kind = kind;
+    n->child = -1;
+    n->next = -1;
+    n->min = n->max = 1;
+    n->st.type = RE_REGULAR;
+    n->st.min = n->st.max = 1;
+    n->st.symbols[0].type = RE_LAST;
+    return p->count++;
+}
+
+/*
+    Reads the escaped symbol after '\'.
+*/
+static void parseEscape(re_parser *p, re_symbol *sym)
+{
+    unsigned int length;
+    switch (p->pattern[p->i])
+    {
+    case '\0':
+        p->error = true;
+        return;
+    case 'd':
+        sym->type = RE_NUMERIC;
+        break;
+    case 'D':
+        sym->type = RE_NONNUMERIC;
+        break;
+    case 's':
+        sym->type = RE_SPACE;
+        break;
+    case 'S':
+        sym->type = RE_NONSPACE;
+        break;
+    case 'w':
+        sym->type = RE_ALPHANUMERIC;
+        break;
+    case 'W':
+        sym->type = RE_NONALPHANUMERIC;
+        break;
+
+    default:
+        sym->type = RE_SYMBOL;
+        sym->value.element = readSymbol(p->pattern + p->i, p->length - p->i, p->utf8, &length);
+        p->i += length;
+        return;
+    }
+    sym->value.element = (unsigned char)p->pattern[p->i];
+    ++p->i;
+}
+
+/*
+    Reads the class after '[', '^' at its start negates the class.
+*/
+static void parseClass(re_parser *p, int leaf)
+{
+    const char *pattern = p->pattern;
+    int element = 0;
+    if (pattern[p->i] == '^')
+    {
+        ++p->i;
+        p->nodes[leaf].st.type = RE_NONE;
+    }
+    while (pattern[p->i] != ']')
+    {
+        // '.' and '^' are usual symbols here
+        if (pattern[p->i] == '\0' || element == MAX_CLASS_LENGTH)
+        {
+            p->error = true;
+            return;
+        }
+        re_symbol *sym = &p->nodes[leaf].st.symbols[element++];
+        if (pattern[p->i] == '\\')
+        {
+            ++p->i;
+            parseEscape(p, sym); // '-' stands for range, so you should to write '\-'
+            continue;
+        }
+
+        unsigned int length;
+        unsigned int first = readSymbol(pattern + p->i, p->length - p->i, p->utf8, &length);
+        p->i += length;
+        if (pattern[p->i] == '-' && pattern[p->i + 1] != ']' && pattern[p->i + 1] != '\0')
+        {
+            ++p->i;
+            sym->type = RE_RANGE;
+            sym->value.rng.start = first;
+            sym->value.rng.finish = readSymbol(pattern + p->i, p->length - p->i, p->utf8, &length);
+            p->i += length;
+        }
+        else
+        {
+            sym->type = RE_SYMBOL;
+            sym->value.element = first;
+        }
+    }
+    ++p->i;
+    p->nodes[leaf].st.symbols[element].type = RE_LAST;
+}
+
+/*
+    Reads a nonnegative number of repetitions, that is less than infinity.
+*/
+static unsigned short parseNumber(re_parser *p)
+{
+    unsigned int n = 0;
+    while (isdigit((unsigned char)p->pattern[p->i]))
+    {
+        n = n * 10 + (p->pattern[p->i] - '0');
+        ++p->i;
+        if (n >= RE_INFINITY_REPETITIONS)
+        {
+            p->error = true;
+            return 0;
+        }
+    }
+    return n;
+}
+
+/*
+    Reads the quantifier: '+', '*', '?', {n}, {n,} or {n,m}.
+*/
+static void parseQuantifier(re_parser *p, unsigned short *min, unsigned short *max)
+{
+    const char *pattern = p->pattern;
+    switch (pattern[p->i++])
+    {
+    case '+': // 1 .. inf
+        *min = 1;
+        *max = RE_INFINITY_REPETITIONS;
+        return;
+    case '*': // 0 .. inf
+        *min = 0;
+        *max = RE_INFINITY_REPETITIONS;
+        return;
+    case '?': // 0 .. 1
+        *min = 0;
+        *max = 1;
+        return;
+
+    default:
+        break;
+    }
+
+    while (pattern[p->i] == ' ')
+    {
+        ++p->i;
+    }
+    *min = *max = parseNumber(p);
+    while (pattern[p->i] == ' ')
+    {
+        ++p->i;
+    }
+    if (pattern[p->i] == ',')
+    {
+        ++p->i;
+        while (pattern[p->i] == ' ')
+        {
+            ++p->i;
+        }
+        *max = isdigit((unsigned char)pattern[p->i]) ? parseNumber(p) : RE_INFINITY_REPETITIONS;
+        while (pattern[p->i] == ' ')
+        {
+            ++p->i;
+        }
+    }
+    if (pattern[p->i] != '}' || *max < *min)
+    {
+        p->error = true;
+        return;
+    }
+    ++p->i;
+}
+
+/*
+    Adds the state of the assertion, that consumes nothing.
+*/
+static int newAssertion(re_parser *p, int look)
+{
+    int leaf = newNode(p, RE_NODE_LEAF);
+    p->nodes[leaf].st.type = RE_ASSERTION;
+    p->nodes[leaf].st.symbols[0].type = RE_SYMBOL;
+    p->nodes[leaf].st.symbols[0].value.element = look;
+    p->nodes[leaf].st.symbols[1].type = RE_LAST;
+    return leaf;
+}
+
+/*
+    Reads a group, a class, an assertion or a single symbol.
+*/
+static int parseAtom(re_parser *p)
+{
+    const char *pattern = p->pattern;
+    int leaf;
+    unsigned int length;
+    switch (pattern[p->i])
+    {
+    case '(':
+    {
+        if (++p->depth > MAX_PATTERN_LENGTH)
+        {
+            p->error = true;
+            return -1;
+        }
+        ++p->i;
+        int group = newNode(p, RE_NODE_GROUP);
+        p->nodes[group].group = ++p->groups;
+        int child = parseAlternation(p);
+        if (p->error || pattern[p->i] != ')')
+        {
+            p->error = true;
+            return -1;
+        }
+        ++p->i;
+        --p->depth;
+        p->nodes[group].child = child;
+        return group;
+    }
+    case '\0':
+    case '|':
+    case ')':
+    case '+':
+    case '*':
+    case '?':
+    case '{':
+        p->error = true; // nothing to repeat
+        return -1;
+    case '^':
+        ++p->i;
+        return newAssertion(p, p->multiline ? RE_LOOK_LINE_START : RE_LOOK_TEXT_START);
+    case '$':
+        ++p->i;
+        return newAssertion(p, p->multiline ? RE_LOOK_LINE_END : RE_LOOK_TEXT_END);
+    case '[':
+        ++p->i;
+        leaf = newNode(p, RE_NODE_LEAF);
+        parseClass(p, leaf);
+        return leaf;
+    case '.':
+        ++p->i;
+        leaf = newNode(p, RE_NODE_LEAF);
+        p->nodes[leaf].st.symbols[0].type = RE_DOT;
+        p->nodes[leaf].st.symbols[0].value.element = '.';
+        p->nodes[leaf].st.symbols[1].type = RE_LAST;
+        break;
+    case '\\':
+        ++p->i;
+        if (pattern[p->i] == 'b' || pattern[p->i] == 'B')
+        {
+            return newAssertion(p, pattern[p->i++] == 'b' ? RE_LOOK_WORD : RE_LOOK_NOT_WORD);
+        }
+        leaf = newNode(p, RE_NODE_LEAF);
+        parseEscape(p, &p->nodes[leaf].st.symbols[0]);
+        p->nodes[leaf].st.symbols[1].type = RE_LAST;
+        break;
+
+    default:
+        leaf = newNode(p, RE_NODE_LEAF);
+        p->nodes[leaf].st.symbols[0].type = RE_SYMBOL;
+        p->nodes[leaf].st.symbols[0].value.element = readSymbol(pattern + p->i, p->length - p->i, p->utf8, &length);
+        p->nodes[leaf].st.symbols[1].type = RE_LAST;
+        p->i += length;
+        break;
+    }
+    return leaf;
+}
+
+/*
+    Reads an atom with its quantifiers.
+*/
+static int parseRepeat(re_parser *p)
+{
+    int atom = parseAtom(p);
+    for (int repeats = 0; !p->error && p->pattern[p->i] != '\0' && strchr("+*?{", p->pattern[p->i]) != NULL; repeats++)
+    {
+        if (repeats == MAX_PATTERN_LENGTH)
+        {
+            p->error = true;
+            break;
+        }
+        unsigned short min, max;
+        parseQuantifier(p, &min, &max);
+        int repeat = newNode(p, RE_NODE_REPEAT);
+        p->nodes[repeat].child = atom;
+        p->nodes[repeat].min = min;
+        p->nodes[repeat].max = max;
+        atom = repeat;
+    }
+    return atom;
+}
+
+/*
+    Reads atoms until '|', ')' or the end of the pattern.
+*/
+static int parseConcat(re_parser *p)
+{
+    int concat = newNode(p, RE_NODE_CONCAT), last = -1;
+    while (!p->error && p->pattern[p->i] != '\0' && p->pattern[p->i] != '|' && p->pattern[p->i] != ')')
+    {
+        int item = parseRepeat(p);
+        if (p->error)
+        {
+            break;
+        }
+        if (last == -1)
+        {
+            p->nodes[concat].child = item;
+        }
+        else
+        {
+            p->nodes[last].next = item;
+        }
+        last = item;
+    }
+    return concat; // empty one matches the empty string
+}
+
+/*
+    Reads alternatives separated by '|'.
+*/
+static int parseAlternation(re_parser *p)
+{
+    int first = parseConcat(p);
+    if (p->error || p->pattern[p->i] != '|')
+    {
+        return first;
+    }
+
+    int alternation = newNode(p, RE_NODE_ALTERNATION), last = first;
+    p->nodes[alternation].child = first;
+    while (!p->error && p->pattern[p->i] == '|')
+    {
+        ++p->i;
+        int item = parseConcat(p);
+        p->nodes[last].next = item;
+        last = item;
+    }
+    return alternation;
+}
+
+/*
+    Stores children of the node into items and returns their number.
+*/
+static int collectChildren(re_parser *p, int n, int **items)
+{
+    int count = 0;
+    for (int c = p->nodes[n].child; c != -1; c = p->nodes[c].next)
+    {
+        ++count;
+    }
+    *items = (int *)malloc((count + 1) * sizeof(int));
+    count = 0;
+    for (int c = p->nodes[n].child; c != -1; c = p->nodes[c].next)
+    {
+        (*items)[count++] = c;
+    }
+    return count;
+}
+
+static void linkChildren(re_parser *p, int n, const int *items, int count)
+{
+    p->nodes[n].child = count > 0 ? items[0] : -1;
+    for (int k = 0; k < count; k++)
+    {
+        p->nodes[items[k]].next = k + 1 < count ? items[k + 1] : -1;
+    }
+}
+
+static bool equalStates(const re_state *a, const re_state *b, bool counters)
+{
+    if (a->type != b->type || (counters && (a->min != b->min || a->max != b->max)))
+    {
+        return false;
+    }
+    for (int i = 0; i <= MAX_CLASS_LENGTH; i++)
+    {
+        const re_symbol *x = &a->symbols[i], *y = &b->symbols[i];
+        if (x->type != y->type)
+        {
+            return false;
+        }
+        if (x->type == RE_LAST)
+        {
+            return true;
+        }
+        if (x->type == RE_RANGE ? x->value.rng.start != y->value.rng.start || x->value.rng.finish != y->value.rng.finish
+                             : x->value.element != y->value.element)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    Replaces {p,q} repeated {r,s} times with a single repetition, if it matches the same numbers of copies:
+the ranges of copies for k and k + 1 repetitions have to touch, and zero repetitions has to touch p.
+*/
+static bool mergeRepetitions(unsigned int p, unsigned int q, unsigned int r, unsigned int s, unsigned short *min, unsigned short *max)
+{
+    bool infinite = q == RE_INFINITY_REPETITIONS || s == RE_INFINITY_REPETITIONS;
+    unsigned int k = r > 0 ? r : 1;
+    if ((r == 0 && p > 1) || (q != RE_INFINITY_REPETITIONS && s > k && k * q + 1 < (k + 1) * p))
+    {
+        return false;
+    }
+    if (r * p >= RE_INFINITY_REPETITIONS || (!infinite && s * q >= RE_INFINITY_REPETITIONS))
+    {
+        return false;
+    }
+    *min = r * p;
+    *max = infinite ? RE_INFINITY_REPETITIONS : s * q;
+    return true;
+}
+
+/*
+    Flattens nested sequences, drops empty items and joins neighbour states with the same symbols: aa+ -> a{2,}.
+*/
+static int optimizeConcat(re_parser *p, int n)
+{
+    int *items;
+    int count = collectChildren(p, n, &items);
+    int *flat = NULL, flatCount = 0, flatCapacity = 0;
+    for (int k = 0; k < count; k++)
+    {
+        int item = optimizeNode(p, items[k]);
+        int *children = &item, childrenCount = 1;
+        if (p->nodes[item].kind == RE_NODE_CONCAT)
+        {
+            childrenCount = collectChildren(p, item, &children);
+        }
+        for (int c = 0; c < childrenCount; c++)
+        {
+            re_node *current = &p->nodes[children[c]];
+            re_node *previous = flatCount > 0 ? &p->nodes[flat[flatCount - 1]] : NULL;
+            if (current->kind == RE_NODE_EMPTY)
+            {
+                continue;
+            }
+            if (previous != NULL && previous->kind == RE_NODE_LEAF && current->kind == RE_NODE_LEAF && equalStates(&previous->st, &current->st, false))
+            {
+                bool infinite = previous->st.max == RE_INFINITY_REPETITIONS || current->st.max == RE_INFINITY_REPETITIONS;
+                unsigned int min = previous->st.min + current->st.min;
+                unsigned int max = infinite ? RE_INFINITY_REPETITIONS : previous->st.max + current->st.max;
+                if (min < RE_INFINITY_REPETITIONS && (infinite || max < RE_INFINITY_REPETITIONS))
+                {
+                    previous->st.min = min;
+                    previous->st.max = max;
+                    continue;
+                }
+            }
+            appendInt(&flat, &flatCount, &flatCapacity, children[c]);
+        }
+        if (children != &item)
+        {
+            free(children);
+        }
+    }
+    free(items);
+
+    int result = n;
+    if (flatCount == 0)
+    {
+        p->nodes[n].kind = RE_NODE_EMPTY;
+        p->nodes[n].child = -1;
+    }
+    else if (flatCount == 1)
+    {
+        result = flat[0];
+    }
+    else
+    {
+        linkChildren(p, n, flat, flatCount);
+    }
+    free(flat);
+    return result;
+}
+
+/*
+    Returns the state, that the item starts with, or -1.
+*/
+static int headLeaf(re_parser *p, int item)
+{
+    if (p->nodes[item].kind == RE_NODE_LEAF)
+    {
+        return item;
+    }
+    if (p->nodes[item].kind == RE_NODE_CONCAT && p->nodes[p->nodes[item].child].kind == RE_NODE_LEAF)
+    {
+        return p->nodes[item].child;
+    }
+    return -1;
+}
+
+/*
+    Returns the item without its first state.
+*/
+static int restOf(re_parser *p, int item)
+{
+    if (p->nodes[item].kind == RE_NODE_LEAF)
+    {
+        return newNode(p, RE_NODE_EMPTY);
+    }
+    int rest = newNode(p, RE_NODE_CONCAT);
+    p->nodes[rest].child = p->nodes[p->nodes[item].child].next;
+    return rest;
+}
+
+/*
+    Flattens nested alternatives, factors common leading states out (abc|abd -> ab[cd]),
+merges single symbols and classes into one class (a|[bc] -> [abc]) and turns an empty alternative into '?'.
+*/
+static int optimizeAlternation(re_parser *p, int n)
+{
+    int *items;
+    int count = collectChildren(p, n, &items);
+    int *flat = NULL, flatCount = 0, flatCapacity = 0;
+    bool empty = false;
+    for (int k = 0; k < count; k++)
+    {
+        int item = optimizeNode(p, items[k]);
+        int *children = &item, childrenCount = 1;
+        if (p->nodes[item].kind == RE_NODE_ALTERNATION)
+        {
+            childrenCount = collectChildren(p, item, &children);
+        }
+        for (int c = 0; c < childrenCount; c++)
+        {
+            if (p->nodes[children[c]].kind == RE_NODE_EMPTY)
+            {
+                empty = true;
+            }
+            else
+            {
+                appendInt(&flat, &flatCount, &flatCapacity, children[c]);
+            }
+        }
+        if (children != &item)
+        {
+            free(children);
+        }
+    }
+    free(items);
+
+    // common leading states, the order of alternatives doesn't matter for the longest match
+    for (int i = 0; i < flatCount; i++)
+    {
+        int head = headLeaf(p, flat[i]);
+        if (head == -1)
+        {
+            continue;
+        }
+        int rests = newNode(p, RE_NODE_ALTERNATION), last = restOf(p, flat[i]);
+        p->nodes[rests].child = last;
+        int kept = i + 1;
+        for (int k = i + 1; k < flatCount; k++)
+        {
+            int other = headLeaf(p, flat[k]);
+            if (other != -1 && equalStates(&p->nodes[head].st, &p->nodes[other].st, true))
+            {
+                int rest = restOf(p, flat[k]);
+                p->nodes[last].next = rest;
+                last = rest;
+            }
+            else
+            {
+                flat[kept++] = flat[k];
+            }
+        }
+        if (kept == flatCount)
+        {
+            continue; // nothing to factor, the new nodes are left unused
+        }
+        flatCount = kept;
+
+        int concat = newNode(p, RE_NODE_CONCAT);
+        p->nodes[concat].child = head;
+        p->nodes[head].next = rests;
+        p->nodes[rests].next = -1;
+        flat[i] = optimizeNode(p, concat);
+    }
+
+    // single symbols
+    int merged = -1, kept = 0;
+    for (int k = 0; k < flatCount; k++)
+    {
+        int item = flat[k];
+        re_state *st = &p->nodes[item].st;
+        bool single = p->nodes[item].kind == RE_NODE_LEAF && st->type == RE_REGULAR && st->min == 1 && st->max == 1;
+        if (single && merged != -1)
+        {
+            re_state *target = &p->nodes[merged].st;
+            int length = 0, added = 0;
+            while (target->symbols[length].type != RE_LAST)
+            {
+                ++length;
+            }
+            while (st->symbols[added].type != RE_LAST)
+            {
+                ++added;
+            }
+            if (length + added <= MAX_CLASS_LENGTH)
+            {
+                memcpy(target->symbols + length, st->symbols, (added + 1) * sizeof(re_symbol));
+                continue;
+            }
+        }
+        if (single)
+        {
+            merged = item;
+        }
+        flat[kept++] = item;
+    }
+    flatCount = kept;
+
+    int result = n;
+    if (flatCount == 0)
+    {
+        p->nodes[n].kind = RE_NODE_EMPTY;
+        p->nodes[n].child = -1;
+    }
+    else if (flatCount == 1)
+    {
+        result = flat[0];
+    }
+    else
+    {
+        linkChildren(p, n, flat, flatCount);
+    }
+    free(flat);
+
+    if (empty && p->nodes[result].kind != RE_NODE_EMPTY)
+    {
+        int optional = newNode(p, RE_NODE_REPEAT);
+        p->nodes[optional].min = 0;
+        p->nodes[optional].max = 1;
+        p->nodes[optional].child = result;
+        result = optimizeNode(p, optional);
+    }
+    return result;
+}
+
+/*
+    Drops trivial repetitions and merges nested ones into a single state or repetition: (a{2})+ -> a{2,}.
+*/
+static int optimizeRepeat(re_parser *p, int n)
+{
+    int child = optimizeNode(p, p->nodes[n].child);
+    p->nodes[n].child = child;
+    p->nodes[child].next = -1;
+    if (p->nodes[n].max == 0 || p->nodes[child].kind == RE_NODE_EMPTY)
+    {
+        p->nodes[n].kind = RE_NODE_EMPTY;
+        p->nodes[n].child = -1;
+        return n;
+    }
+    if (p->nodes[n].min == 1 && p->nodes[n].max == 1)
+    {
+        return child;
+    }
+
+    re_node *inner = &p->nodes[child];
+    unsigned short *min = inner->kind == RE_NODE_LEAF ? &inner->st.min : &inner->min;
+    unsigned short *max = inner->kind == RE_NODE_LEAF ? &inner->st.max : &inner->max;
+    if ((inner->kind == RE_NODE_LEAF || inner->kind == RE_NODE_REPEAT) && mergeRepetitions(*min, *max, p->nodes[n].min, p->nodes[n].max, min, max))
+    {
+        return child;
+    }
+    return n;
+}
+
+/*
+    Simplifies the tree and returns the new root of the subtree, its next link has to be set by the caller.
+*/
+static int optimizeNode(re_parser *p, int n)
+{
+    switch (p->nodes[n].kind)
+    {
+    case RE_NODE_CONCAT:
+        return optimizeConcat(p, n);
+    case RE_NODE_ALTERNATION:
+        return optimizeAlternation(p, n);
+    case RE_NODE_REPEAT:
+        return optimizeRepeat(p, n);
+    case RE_NODE_GROUP:
+    {
+        int child = optimizeNode(p, p->nodes[n].child); // the nodes can move
+        p->nodes[n].child = child;
+        p->nodes[child].next = -1;
+        return n;
+    }
+
+    default:
+        return n;
+    }
+}
+
+/*
+    Returns the set of groups, that are passed with the empty string, it is added if it is new.
+
+Arguments:
+groups - numbers of the groups, outer ones first
+*/
+static short skipSet(re_regex *reg, re_parser *p, const int *groups, int count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    for (int s = 1; s < reg->skipCount; s++)
+    {
+        int offset = reg->skipOffsets[s];
+        if (reg->skipOffsets[s + 1] - offset == count && memcmp(reg->skipGroups + offset, groups, count * sizeof(int)) == 0)
+        {
+            return (short)s;
+        }
+    }
+    if (reg->skipCount == SHRT_MAX)
+    {
+        p->error = true;
+        return 0;
+    }
+
+    int s = reg->skipCount++, total = reg->skipOffsets[s];
+    reg->skipGroups = (int *)realloc(reg->skipGroups, (total + count) * sizeof(int));
+    memcpy(reg->skipGroups + total, groups, count * sizeof(int));
+    reg->skipOffsets = (int *)realloc(reg->skipOffsets, (s + 2) * sizeof(int));
+    reg->skipOffsets[s + 1] = total + count;
+    return (short)s;
+}
+
+/*
+    Returns the set of groups of a followed by the groups of b.
+*/
+static short joinSkips(re_regex *reg, re_parser *p, short a, short b)
+{
+    if (a == 0 || a == b)
+    {
+        return b;
+    }
+    if (b == 0)
+    {
+        return a;
+    }
+
+    int count = 0;
+    int *groups = (int *)malloc((reg->skipOffsets[a + 1] - reg->skipOffsets[a] + reg->skipOffsets[b + 1] - reg->skipOffsets[b]) * sizeof(int));
+    for (int g = reg->skipOffsets[a]; g < reg->skipOffsets[a + 1]; g++)
+    {
+        groups[count++] = reg->skipGroups[g];
+    }
+    for (int g = reg->skipOffsets[b]; g < reg->skipOffsets[b + 1]; g++)
+    {
+        bool repeated = false;
+        for (int i = 0; i < count && !repeated; i++)
+        {
+            repeated = groups[i] == reg->skipGroups[g];
+        }
+        if (!repeated)
+        {
+            groups[count++] = reg->skipGroups[g];
+        }
+    }
+    short joined = skipSet(reg, p, groups, count);
+    free(groups);
+    return joined;
+}
+
+/*
+    Sets the groups, that the edge j -> k passes with the empty string, k is 0 at the end of the match.
+*/
+static void setSkips(re_regex *reg, int j, int k, short set)
+{
+    if (reg->skips == NULL && set != 0)
+    {
+        reg->skips = (short(*)[MAX_PATTERN_LENGTH])calloc(MAX_PATTERN_LENGTH, sizeof(*reg->skips));
+    }
+    if (reg->skips != NULL)
+    {
+        reg->skips[j][k] = set;
+    }
+}
+
+/*
+    Connects states, depth is the depth of the node, that creates the edges.
+
+Arguments:
+fromSkips, toSkips - groups, that match the empty string after the states of from and before the states of to
+*/
+static void connectStates(re_regex *reg, re_parser *p, const bool *from, const short *fromSkips, const bool *to, const short *toSkips, int depth)
+{
+    for (int j = 0; j <= reg->size; j++)
+    {
+        for (int k = 1; k <= reg->size && from[j]; k++)
+        {
+            if (!to[k])
+            {
+                continue;
+            }
+            bool replaced = !reg->nfa[j][k];
+            if (reg->edgeDepth != NULL)
+            {
+                int edge = depth;
+                replaced = replaced || depth > reg->edgeDepth[j][k];
+                if (reg->nfa[j][k] && reg->edgeDepth[j][k] != depth)
+                {
+                    p->ambiguous = true;
+                    edge = depth > reg->edgeDepth[j][k] ? depth : reg->edgeDepth[j][k]; // the inner path is greedy
+                }
+                reg->edgeDepth[j][k] = edge;
+            }
+            reg->nfa[j][k] = true;
+            if (replaced)
+            {
+                setSkips(reg, j, k, joinSkips(reg, p, fromSkips[j], toSkips[k]));
+            }
+        }
+    }
+}
+
+/*
+    Appends the part to the sequence out.
+*/
+static void concatPositions(re_regex *reg, re_parser *p, re_positions *out, const re_positions *part, int depth)
+{
+    connectStates(reg, p, out->last, out->lastSkips, part->first, part->firstSkips, depth);
+    for (int k = 0; k < MAX_PATTERN_LENGTH; k++)
+    {
+        if (out->nullable && part->first[k])
+        {
+            out->firstSkips[k] = joinSkips(reg, p, out->emptySkips, part->firstSkips[k]);
+        }
+        if (part->last[k])
+        {
+            out->lastSkips[k] = part->lastSkips[k];
+        }
+        else if (part->nullable && out->last[k])
+        {
+            out->lastSkips[k] = joinSkips(reg, p, out->lastSkips[k], part->emptySkips);
+        }
+        out->first[k] = out->first[k] || (out->nullable && part->first[k]);
+        out->last[k] = part->last[k] || (part->nullable && out->last[k]);
+    }
+    out->emptySkips = out->nullable && part->nullable ? joinSkips(reg, p, out->emptySkips, part->emptySkips) : 0;
+    out->nullable = out->nullable && part->nullable;
+}
+
+/*
+    Unrolls the repetition of the node: mandatory copies, then a loop or nested optional copies.
+*/
+static bool repeatPositions(re_regex *reg, re_parser *p, int n, int depth, re_positions *out)
+{
+    unsigned short min = p->nodes[n].min, max = p->nodes[n].max;
+    int child = p->nodes[n].child;
+    re_positions part;
+    for (int r = 0; r < min; r++)
+    {
+        if (!buildStates(reg, p, child, depth + 1, &part))
+        {
+            return false;
+        }
+        if (r + 1 == min && max == RE_INFINITY_REPETITIONS)
+        {
+            connectStates(reg, p, part.last, part.lastSkips, part.first, part.firstSkips, depth); // x{n,} = x{n-1}x+
+        }
+        concatPositions(reg, p, out, &part, depth);
+    }
+
+    if (max == RE_INFINITY_REPETITIONS && min == 0)
+    {
+        if (!buildStates(reg, p, child, depth + 1, &part))
+        {
+            return false;
+        }
+        connectStates(reg, p, part.last, part.lastSkips, part.first, part.firstSkips, depth);
+        part.nullable = true; // the empty path is an empty iteration if there is one, otherwise none
+        concatPositions(reg, p, out, &part, depth);
+    }
+    else if (max != RE_INFINITY_REPETITIONS)
+    {
+        // x{n,m} = x{n}(x(x...)?)?: the next copy is entered only after the previous one
+        bool entry[MAX_PATTERN_LENGTH];
+        short entrySkips[MAX_PATTERN_LENGTH];
+        bool skipped = out->nullable;
+        short skippedSkips = out->emptySkips;
+        memcpy(entry, out->last, sizeof(entry));
+        memcpy(entrySkips, out->lastSkips, sizeof(entrySkips));
+        for (int r = min; r < max; r++)
+        {
+            if (!buildStates(reg, p, child, depth + 1, &part))
+            {
+                return false;
+            }
+            connectStates(reg, p, entry, entrySkips, part.first, part.firstSkips, depth);
+            for (int k = 0; k < MAX_PATTERN_LENGTH; k++)
+            {
+                if (skipped && part.first[k])
+                {
+                    out->firstSkips[k] = joinSkips(reg, p, skippedSkips, part.firstSkips[k]);
+                }
+                if (part.last[k])
+                {
+                    out->lastSkips[k] = entrySkips[k] = part.lastSkips[k];
+                }
+                else if (part.nullable && entry[k])
+                {
+                    entrySkips[k] = joinSkips(reg, p, entrySkips[k], part.emptySkips);
+                }
+                out->first[k] = out->first[k] || (skipped && part.first[k]);
+                out->last[k] = out->last[k] || part.last[k];
+                entry[k] = part.last[k] || (part.nullable && entry[k]);
+            }
+            if (r == 0 && part.nullable)
+            {
+                out->emptySkips = part.emptySkips; // like x*, x{0,m} matches the empty string with one iteration
+            }
+            skippedSkips = skipped && part.nullable ? joinSkips(reg, p, skippedSkips, part.emptySkips) : 0;
+            skipped = skipped && part.nullable;
+        }
+    }
+    return true;
+}
+
+/*
+    Adds states of the node to the regular expression and links them in Glushkov manner:
+every state is a position of the pattern, edges connect positions, that can follow each other.
+
+Arguments:
+depth - depth of the node in the tree
+out - first and last states of the node
+*/
+static bool buildStates(re_regex *reg, re_parser *p, int n, int depth, re_positions *out)
+{
+    memset(out, 0, sizeof(re_positions));
+    out->nullable = true;
+
+    switch (p->nodes[n].kind)
+    {
+    case RE_NODE_LEAF:
+    {
+        if (reg->size + 2 >= MAX_PATTERN_LENGTH)
+        {
+            return false;
+        }
+        int j = ++reg->size;
+        reg->states[j] = p->nodes[n].st;
+
+        // groups around the state, outer ones first
+        reg->memberOffsets[j + 1] = reg->memberOffsets[j] + p->openCount;
+        reg->members = (re_membership *)realloc(reg->members, (reg->memberOffsets[j + 1] + 1) * sizeof(re_membership));
+        memcpy(reg->members + reg->memberOffsets[j], p->open, p->openCount * sizeof(re_membership));
+        if (reg->states[j].type == RE_ASSERTION)
+        {
+            // a repeated assertion checks the same place again
+            reg->states[j].min = reg->states[j].min > 1 ? 1 : reg->states[j].min;
+            reg->states[j].max = 1;
+        }
+        out->nullable = reg->states[j].min == 0;
+        if (out->nullable)
+        {
+            reg->states[j].min = 1; // skipping of the state is an edge of the graph
+        }
+        out->first[j] = out->last[j] = true;
+        return true;
+    }
+    case RE_NODE_CONCAT:
+    case RE_NODE_ALTERNATION:
+    {
+        bool sequence = p->nodes[n].kind == RE_NODE_CONCAT;
+        out->nullable = sequence;
+        re_positions part;
+        for (int c = p->nodes[n].child; c != -1; c = p->nodes[c].next)
+        {
+            if (!buildStates(reg, p, c, depth + 1, &part))
+            {
+                return false;
+            }
+            if (sequence)
+            {
+                concatPositions(reg, p, out, &part, depth);
+                continue;
+            }
+            for (int k = 0; k < MAX_PATTERN_LENGTH; k++)
+            {
+                out->firstSkips[k] = part.first[k] ? part.firstSkips[k] : out->firstSkips[k];
+                out->lastSkips[k] = part.last[k] ? part.lastSkips[k] : out->lastSkips[k];
+                out->first[k] = out->first[k] || part.first[k];
+                out->last[k] = out->last[k] || part.last[k];
+            }
+            if (!out->nullable && part.nullable)
+            {
+                out->emptySkips = part.emptySkips; // earlier alternatives are preferred
+            }
+            out->nullable = out->nullable || part.nullable;
+        }
+        return true;
+    }
+    case RE_NODE_REPEAT:
+        return repeatPositions(reg, p, n, depth, out);
+    case RE_NODE_GROUP:
+    {
+        p->open[p->openCount].group = p->nodes[n].group;
+        p->open[p->openCount++].depth = depth;
+        bool built = buildStates(reg, p, p->nodes[n].child, depth + 1, out);
+        --p->openCount;
+        if (built && out->nullable)
+        {
+            out->emptySkips = joinSkips(reg, p, skipSet(reg, p, &p->nodes[n].group, 1), out->emptySkips);
+        }
+        return built;
+    }
+
+    default:
+        return true; // RE_NODE_EMPTY
+    }
+}
+
+/*
+    Checks if the byte corresponds to the state.
+
+Arguments:
+classes - table of RE_CLASS_* bits of bytes
+*/
+static bool matchState(re_state *st, unsigned char c, const unsigned char *classes)
+{
+    bool matches = false;
+    if (st->type == RE_ASSERTION)
+    {
+        return false; // it doesn't consume bytes
+    }
+
+    int i = 0;
+    while (!matches && st->symbols[i].type != RE_LAST)
+    {
+
+        if (st->symbols[i].type == RE_DOT)
+        {
+            matches = c < 0x80;
+        }
+        else if (st->symbols[i].type == RE_SYMBOL)
+        {
+            matches = c == (*st).symbols[i].value.element;
+        }
+        else if (st->symbols[i].type == RE_RANGE)
+        {
+            matches = (*st).symbols[i].value.rng.start <= c && (*st).symbols[i].value.rng.finish >= c;
+        }
+        else
+        {
+            switch ((*st).symbols[i].type)
+            {
+            case RE_NUMERIC:
+                matches = classes[c] & RE_CLASS_DIGIT;
+                break;
+            case RE_NONNUMERIC:
+                matches = !(classes[c] & RE_CLASS_DIGIT);
+                break;
+            case RE_SPACE:
+                matches = classes[c] & RE_CLASS_SPACE;
+                break;
+            case RE_NONSPACE:
+                matches = !(classes[c] & RE_CLASS_SPACE);
+                break;
+            case RE_ALPHANUMERIC:
+                matches = classes[c] & RE_CLASS_WORD;
+                break;
+            case RE_NONALPHANUMERIC:
+                matches = !(classes[c] & RE_CLASS_WORD);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        ++i;
+    }
+
+    return ((*st).type == RE_REGULAR) == matches;
+}
+
+/*
+    State of the construction of the byte automata.
+
+list - transitions as triples (from, label, to)
+units - ways to consume one symbol of the current state: sequences of labels,
+        each one is stored as its length followed by labels
+*/
+typedef struct re_builder
+{
+    re_automata *nfa;
+    int nodes;
+    int setsCapacity;
+
+    int *list;
+    int count;
+    int capacity;
+
+    int *units;
+    int unitsCount;
+    int unitsCapacity;
+    unsigned char single[32]; // one byte sequences of the current state, they share one label
+} re_builder;
+
+static void appendInt(int **array, int *count, int *capacity, int value)
+{
+    if (*count == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *array = (int *)realloc(*array, *capacity * sizeof(int));
+    }
+    (*array)[(*count)++] = value;
+}
+
+static void addTransition(re_builder *b, int from, int label, int to)
+{
+    appendInt(&b->list, &b->count, &b->capacity, from);
+    appendInt(&b->list, &b->count, &b->capacity, label);
+    appendInt(&b->list, &b->count, &b->capacity, to);
+}
+
+/*
+    Returns the label of the byte set, equal sets share the label.
+*/
+static int addSet(re_builder *b, const unsigned char *bits)
+{
+    re_automata *nfa = b->nfa;
+    for (int label = 0; label < nfa->setsCount; label++)
+    {
+        if (memcmp(nfa->sets[label], bits, 32) == 0)
+        {
+            return label;
+        }
+    }
+
+    if (nfa->setsCount == b->setsCapacity)
+    {
+        b->setsCapacity = b->setsCapacity ? b->setsCapacity * 2 : 16;
+        nfa->sets = (unsigned char(*)[32])realloc(nfa->sets, b->setsCapacity * sizeof(*nfa->sets));
+    }
+    memcpy(nfa->sets[nfa->setsCount], bits, 32);
+    return nfa->setsCount++;
+}
+
+static int addByteRange(re_builder *b, unsigned char first, unsigned char last)
+{
+    unsigned char bits[32] = {0};
+    for (int c = first; c <= last; c++)
+    {
+        bits[c >> 3] |= 1 << (c & 7);
+    }
+    return addSet(b, bits);
+}
+
+static int encodeUtf8(unsigned int codepoint, unsigned char *bytes)
+{
+    if (codepoint < 0x80)
+    {
+        bytes[0] = codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800)
+    {
+        bytes[0] = 0xC0 | codepoint >> 6;
+        bytes[1] = 0x80 | (codepoint & 0x3F);
+        return 2;
+    }
+    if (codepoint < 0x10000)
+    {
+        bytes[0] = 0xE0 | codepoint >> 12;
+        bytes[1] = 0x80 | (codepoint >> 6 & 0x3F);
+        bytes[2] = 0x80 | (codepoint & 0x3F);
+        return 3;
+    }
+    bytes[0] = 0xF0 | codepoint >> 18;
+    bytes[1] = 0x80 | (codepoint >> 12 & 0x3F);
+    bytes[2] = 0x80 | (codepoint >> 6 & 0x3F);
+    bytes[3] = 0x80 | (codepoint & 0x3F);
+    return 4;
+}
+
+/*
+    Adds the range of codepoints to the units of the current state.
+
+The range is split until all its codepoints are encoded with the same number of bytes and every byte
+of the encoding runs over a range independently of others, then it is one sequence of byte ranges.
+*/
+static void addUtf8Range(re_builder *b, unsigned int first, unsigned int last)
+{
+    static const unsigned int limits[] = {0x7F, 0x7FF, 0xFFFF};
+
+    if (first > last)
+    {
+        return;
+    }
+    if (first <= 0xDFFF && last >= 0xD800) // surrogates are not encoded
+    {
+        if (first < 0xD800)
+        {
+            addUtf8Range(b, first, 0xD7FF);
+        }
+        if (last > 0xDFFF)
+        {
+            addUtf8Range(b, 0xE000, last);
+        }
+        return;
+    }
+    for (int n = 0; n < 3; n++)
+    {
+        if (first <= limits[n] && last > limits[n])
+        {
+            addUtf8Range(b, first, limits[n]);
+            addUtf8Range(b, limits[n] + 1, last);
+            return;
+        }
+    }
+    if (last < 0x80)
+    {
+        for (unsigned int c = first; c <= last; c++)
+        {
+            b->single[c >> 3] |= 1 << (c & 7);
+        }
+        return;
+    }
+    for (int k = 1; k < 4; k++)
+    {
+        unsigned int mask = (1u << (6 * k)) - 1;
+        if ((first & ~mask) != (last & ~mask))
+        {
+            if ((first & mask) != 0)
+            {
+                addUtf8Range(b, first, first | mask);
+                addUtf8Range(b, (first | mask) + 1, last);
+                return;
+            }
+            if ((last & mask) != mask)
+            {
+                addUtf8Range(b, first, (last & ~mask) - 1);
+                addUtf8Range(b, last & ~mask, last);
+                return;
+            }
+        }
+    }
+
+    unsigned char from[4], to[4];
+    int length = encodeUtf8(first, from);
+    encodeUtf8(last, to);
+    appendInt(&b->units, &b->unitsCount, &b->unitsCapacity, length);
+    for (int n = 0; n < length; n++)
+    {
+        appendInt(&b->units, &b->unitsCount, &b->unitsCapacity, addByteRange(b, from[n], to[n]));
+    }
+}
+
+/*
+    Sorts and merges ranges, returns their new number.
+*/
+static int normalizeRanges(re_range *ranges, int count)
+{
+    for (int i = 1; i < count; i++)
+    {
+        re_range r = ranges[i];
+        int k = i;
+        for (; k > 0 && ranges[k - 1].start > r.start; k--)
+        {
+            ranges[k] = ranges[k - 1];
+        }
+        ranges[k] = r;
+    }
+
+    int merged = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (merged > 0 && ranges[i].start <= ranges[merged - 1].finish + 1)
+        {
+            if (ranges[i].finish > ranges[merged - 1].finish)
+            {
+                ranges[merged - 1].finish = ranges[i].finish;
+            }
+        }
+        else
+        {
+            ranges[merged++] = ranges[i];
+        }
+    }
+    return merged;
+}
+
+/*
+    Replaces normalized ranges with their complement in [0, RE_MAX_CODEPOINT], returns their new number.
+*/
+static int complementRanges(re_range *ranges, int count)
+{
+    re_range complement[RE_MAX_CLASS_RANGES];
+    int length = 0;
+    unsigned int next = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (ranges[i].start > next)
+        {
+            complement[length].start = next;
+            complement[length++].finish = ranges[i].start - 1;
+        }
+        next = ranges[i].finish + 1;
+    }
+    if (next <= RE_MAX_CODEPOINT)
+    {
+        complement[length].start = next;
+        complement[length++].finish = RE_MAX_CODEPOINT;
+    }
+    memcpy(ranges, complement, length * sizeof(re_range));
+    return length;
+}
+
+/*
+    Appends ascii codepoints of the class or of its complement.
+
+Arguments:
+classes - table of RE_CLASS_* bits of bytes
+bit - RE_CLASS_* bit of the class
+*/
+static int appendClass(re_range *ranges, int count, const unsigned char *classes, unsigned char bit, bool negated)
+{
+    re_range members[65];
+    int length = 0;
+    for (unsigned int c = 0; c < 0x80; c++)
+    {
+        if (!(classes[c] & bit))
+        {
+            continue;
+        }
+        if (length > 0 && members[length - 1].finish + 1 == c)
+        {
+            members[length - 1].finish = c;
+        }
+        else
+        {
+            members[length].start = members[length].finish = c;
+            ++length;
+        }
+    }
+    if (negated)
+    {
+        length = complementRanges(members, length);
+    }
+    memcpy(ranges + count, members, length * sizeof(re_range));
+    return count + length;
+}
+
+/*
+    Returns normalized ranges of codepoints, that the state accepts in utf-8 mode.
+
+Arguments:
+classes - table of RE_CLASS_* bits of bytes
+icase - ascii letters of the ranges are added in the other case before the negation
+*/
+static int codepointRanges(re_state *st, re_range *ranges, const unsigned char *classes, bool icase)
+{
+    int count = 0;
+    if (st->type == RE_ASSERTION)
+    {
+        return 0;
+    }
+    for (int i = 0; st->symbols[i].type != RE_LAST; i++)
+    {
+        re_symbol *sym = &st->symbols[i];
+        switch (sym->type)
+        {
+        case RE_SYMBOL:
+            ranges[count].start = ranges[count].finish = sym->value.element;
+            ++count;
+            break;
+        case RE_RANGE:
+            if (sym->value.rng.start <= sym->value.rng.finish)
+            {
+                ranges[count++] = sym->value.rng;
+            }
+            break;
+        case RE_DOT:
+            ranges[count].start = 0;
+            ranges[count++].finish = RE_MAX_CODEPOINT;
+            break;
+        case RE_NUMERIC:
+        case RE_NONNUMERIC:
+            count = appendClass(ranges, count, classes, RE_CLASS_DIGIT, sym->type == RE_NONNUMERIC);
+            break;
+        case RE_SPACE:
+        case RE_NONSPACE:
+            count = appendClass(ranges, count, classes, RE_CLASS_SPACE, sym->type == RE_NONSPACE);
+            break;
+        case RE_ALPHANUMERIC:
+        case RE_NONALPHANUMERIC:
+            count = appendClass(ranges, count, classes, RE_CLASS_WORD, sym->type == RE_NONALPHANUMERIC);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (icase)
+    {
+        for (int i = 0, length = count; i < length; i++)
+        {
+            unsigned int start = ranges[i].start, finish = ranges[i].finish;
+            if (start <= 'Z' && finish >= 'A')
+            {
+                ranges[count].start = (start > 'A' ? start : 'A') + ('a' - 'A');
+                ranges[count++].finish = (finish < 'Z' ? finish : 'Z') + ('a' - 'A');
+            }
+            if (start <= 'z' && finish >= 'a')
+            {
+                ranges[count].start = (start > 'a' ? start : 'a') - ('a' - 'A');
+                ranges[count++].finish = (finish < 'z' ? finish : 'z') - ('a' - 'A');
+            }
+        }
+    }
+
+    count = normalizeRanges(ranges, count);
+    return st->type == RE_REGULAR ? count : complementRanges(ranges, count);
+}
+
+/*
+    Connects nodes from and to with every unit of the current state.
+*/
+static void addUnit(re_builder *b, int from, int to)
+{
+    for (int u = 0; u < b->unitsCount; u += b->units[u] + 1)
+    {
+        int last = from;
+        for (int n = 1; n < b->units[u]; n++)
+        {
+            addTransition(b, last, b->units[u + n], b->nodes);
+            last = b->nodes++;
+        }
+        addTransition(b, last, b->units[u + b->units[u]], to);
+    }
+}
+
+/*
+    Adds bytes, that the state accepts in byte mode, to the bitmap.
+*/
+static void collectBytes(re_regex *reg, re_state *st, unsigned char *bits)
+{
+    for (int c = 0; c < 256; c++)
+    {
+        bool matches = matchState(st, c, reg->classes);
+        if ((reg->flags & RE_ICASE) && otherCase(c) != c)
+        {
+            // case is folded before the negation of the state
+            bool other = matchState(st, otherCase(c), reg->classes);
+            matches = st->type == RE_REGULAR ? matches || other : matches && other;
+        }
+        if (matches)
+        {
+            bits[c >> 3] |= 1 << (c & 7);
+        }
+    }
+}
+
+/*
+    Builds the byte automata from the states of the regular expression.
+
+In reverse mode every transition is turned backwards and the initial and final nodes are swapped,
+so the automata accepts reversed strings.
+*/
+static re_automata *buildAutomata(re_regex *reg, bool reverse)
+{
+    re_builder b;
+    memset(&b, 0, sizeof(re_builder));
+    re_automata *nfa = b.nfa = (re_automata *)calloc(1, sizeof(re_automata));
+
+    int *entry = (int *)malloc((reg->size + 1) * sizeof(int));
+    int *exit = (int *)malloc((reg->size + 1) * sizeof(int));
+
+    entry[0] = exit[0] = b.nodes++; // RE_FIRST doesn't consume anything
+    for (int k = 1; k <= reg->size; k++)
+    {
+        re_state *st = &reg->states[k];
+        int min = st->min;
+        int max = st->max == RE_INFINITY_REPETITIONS || st->max >= st->min ? st->max : st->min;
+
+        entry[k] = b.nodes++;
+        if (max == 0) // placeholder state, that consumes nothing
+        {
+            exit[k] = entry[k];
+            continue;
+        }
+
+        // units of the state: single bytes or utf-8 sequences of codepoints
+        b.unitsCount = 0;
+        memset(b.single, 0, sizeof(b.single));
+        if (st->type == RE_ASSERTION)
+        {
+            // the assertion looks at both sides, so the reversed automata checks the mirrored one
+            int look = st->symbols[0].value.element;
+            if (reverse && look & (RE_LOOK_TEXT_START | RE_LOOK_TEXT_END))
+            {
+                look ^= RE_LOOK_TEXT_START | RE_LOOK_TEXT_END;
+            }
+            else if (reverse && look & (RE_LOOK_LINE_START | RE_LOOK_LINE_END))
+            {
+                look ^= RE_LOOK_LINE_START | RE_LOOK_LINE_END;
+            }
+            nfa->looks |= look;
+            appendInt(&b.units, &b.unitsCount, &b.unitsCapacity, 1);
+            appendInt(&b.units, &b.unitsCount, &b.unitsCapacity, RE_ASSERTION_LABEL(look));
+        }
+        else if (reg->flags & RE_UTF8)
+        {
+            re_range ranges[RE_MAX_CLASS_RANGES];
+            int count = codepointRanges(st, ranges, reg->classes, reg->flags & RE_ICASE);
+            for (int r = 0; r < count; r++)
+            {
+                addUtf8Range(&b, ranges[r].start, ranges[r].finish);
+            }
+        }
+        else
+        {
+            collectBytes(reg, st, b.single);
+        }
+        for (int c = 0; c < 32; c++)
+        {
+            if (b.single[c])
+            {
+                appendInt(&b.units, &b.unitsCount, &b.unitsCapacity, 1);
+                appendInt(&b.units, &b.unitsCount, &b.unitsCapacity, addSet(&b, b.single));
+                break;
+            }
+        }
+
+        // mandatory repetitions
+        int last = entry[k];
+        for (int r = 0; r < min; r++)
+        {
+            int next = b.nodes++;
+            addUnit(&b, last, next);
+            last = next;
+        }
+
+        if (max == RE_INFINITY_REPETITIONS)
+        {
+            addUnit(&b, last, last);
+            exit[k] = last;
+        }
+        else if (max > min)
+        {
+            // optional repetitions, every one of them can be skipped to the exit
+            exit[k] = b.nodes++;
+            for (int r = min; r < max; r++)
+            {
+                addTransition(&b, last, RE_EPSILON, exit[k]);
+                int next = r + 1 < max ? b.nodes++ : exit[k];
+                addUnit(&b, last, next);
+                last = next;
+            }
+        }
+        else
+        {
+            exit[k] = last;
+        }
+    }
+
+    int accept = b.nodes++;
+    for (int j = 0; j <= reg->size; j++)
+    {
+        for (int k = 1; k <= reg->size; k++)
+        {
+            if (reg->nfa[j][k])
+            {
+                addTransition(&b, exit[j], RE_EPSILON, entry[k]);
+            }
+        }
+        if (reg->finals[j])
+        {
+            addTransition(&b, exit[j], RE_EPSILON, accept);
+        }
+    }
+
+    int nodes = nfa->size = b.nodes;
+    int *list = b.list, count = b.count;
+    nfa->start = reverse ? accept : entry[0];
+    nfa->accept = reverse ? entry[0] : accept;
+
+    // group transitions by the source node, the reversed automata swaps source and target
+    int from = reverse ? 2 : 0, to = reverse ? 0 : 2;
+    nfa->offsets = (int *)calloc(nodes + 1, sizeof(int));
+    nfa->transitions = (re_transition *)malloc((count / 3 + 1) * sizeof(re_transition));
+    for (int t = 0; t < count; t += 3)
+    {
+        ++nfa->offsets[list[t + from] + 1];
+    }
+    for (int n = 0; n < nodes; n++)
+    {
+        nfa->offsets[n + 1] += nfa->offsets[n];
+    }
+    int *fill = (int *)malloc(nodes * sizeof(int));
+    memcpy(fill, nfa->offsets, nodes * sizeof(int));
+    for (int t = 0; t < count; t += 3)
+    {
+        re_transition *tr = &nfa->transitions[fill[list[t + from]]++];
+        tr->label = list[t + 1];
+        tr->target = list[t + to];
+    }
+
+    free(fill);
+    free(list);
+    free(b.units);
+    free(entry);
+    free(exit);
+    if (nfa->looks)
+    {
+        // bytes, that assertions look at, get their own classes: the sets aren't labels of transitions
+        unsigned char newline[32] = {0};
+        newline['\n' >> 3] = 1 << ('\n' & 7);
+        for (int c = 0; c < 256; c++)
+        {
+            if (reg->classes[c] & RE_CLASS_WORD)
+            {
+                nfa->words[c >> 3] |= 1 << (c & 7);
+            }
+        }
+        addSet(&b, nfa->words);
+        addSet(&b, newline);
+    }
+    findByteClasses(nfa);
+    return nfa;
+}
+
+/*
+    Splits bytes into classes, that every byte set either contains or misses as a whole.
+
+Every set refines the classes: members and non-members of a class get different classes,
+then the classes are renumbered in the order of their first byte.
+*/
+static void findByteClasses(re_automata *nfa)
+{
+    unsigned short *columns = nfa->columns;
+    memset(columns, 0, 256 * sizeof(unsigned short));
+    int count = 1;
+    for (int label = 0; label < nfa->setsCount; label++)
+    {
+        int split[2 * 256];
+        memset(split, -1, sizeof(split));
+        count = 0;
+        for (int c = 0; c < 256; c++)
+        {
+            int member = (nfa->sets[label][c >> 3] >> (c & 7)) & 1;
+            int *renamed = &split[2 * columns[c] + member];
+            if (*renamed < 0)
+            {
+                *renamed = count++;
+            }
+            columns[c] = (unsigned short)*renamed;
+        }
+    }
+    columns[RE_END_OF_INPUT] = (unsigned short)count;
+    nfa->width = count + 1;
+}
+
+static void freeAutomata(re_automata *nfa)
+{
+    if (nfa == NULL)
+    {
+        return;
+    }
+    free(nfa->offsets);
+    free(nfa->transitions);
+    free(nfa->sets);
+    free(nfa);
+}
+
+static size_t automataFootprint(re_automata *nfa)
+{
+    return sizeof(re_automata) + (nfa->size + 1) * sizeof(int) + nfa->offsets[nfa->size] * sizeof(re_transition) +
+           nfa->setsCount * sizeof(*nfa->sets);
+}
+
+static re_dfa *createDfa(re_automata *nfa, unsigned char kind)
+{
+    re_dfa *d = (re_dfa *)calloc(1, sizeof(re_dfa));
+    d->nfa = nfa;
+    d->kind = kind;
+    memset(d->starts, -1, sizeof(d->starts));
+    d->marks = (int *)calloc(nfa->size, sizeof(int));
+    d->stack = (int *)malloc(nfa->size * sizeof(int));
+    d->buffer = (int *)malloc((2 * nfa->size + 2) * sizeof(int));
+    d->expanded = (int *)malloc(nfa->size * sizeof(int));
+    d->passed = (int *)calloc(nfa->size, sizeof(int));
+    d->tableSize = 64;
+    d->table = (int *)malloc(d->tableSize * sizeof(int));
+    memset(d->table, -1, d->tableSize * sizeof(int));
+    d->keyOffsets = (int *)calloc(1, sizeof(int));
+    d->memory = dfaFootprint(d, 0, 0, d->tableSize);
+    d->limit = MAX_DFA_MEMORY;
+    return d;
+}
+
+static void freeDfa(re_dfa *d)
+{
+    if (d == NULL)
+    {
+        return;
+    }
+    free(d->transitions);
+    free(d->flags);
+    free(d->keyOffsets);
+    free(d->keys);
+    free(d->table);
+    free(d->marks);
+    free(d->stack);
+    free(d->buffer);
+    free(d->expanded);
+    free(d->passed);
+    free(d);
+}
+
+static unsigned int hashKey(const int *key, int length)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned int)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+    Returns the memory of the dfa with the given sizes of its arrays.
+*/
+static size_t dfaFootprint(re_dfa *d, int capacity, int keysCapacity, int tableSize)
+{
+    return sizeof(re_dfa) + (6 * (size_t)d->nfa->size + 2) * sizeof(int) +
+           (size_t)capacity * (d->nfa->width * sizeof(int) + 1 + sizeof(int)) + sizeof(int) +
+           (size_t)keysCapacity * sizeof(int) + (size_t)tableSize * sizeof(int);
+}
+
+/*
+    Drops all states of the dfa, allocated memory is kept for new states, unless it is over d->limit.
+*/
+static void dfaFlush(re_dfa *d)
+{
+    if (d->memory > d->limit)
+    {
+        // the arrays grew under a larger limit of an earlier call
+        free(d->transitions);
+        free(d->flags);
+        free(d->keys);
+        d->transitions = NULL;
+        d->flags = NULL;
+        d->keys = NULL;
+        d->capacity = 0;
+        d->keysCapacity = 0;
+        d->keyOffsets = (int *)realloc(d->keyOffsets, sizeof(int));
+        d->tableSize = 64;
+        d->table = (int *)realloc(d->table, d->tableSize * sizeof(int));
+        d->memory = dfaFootprint(d, 0, 0, d->tableSize);
+    }
+    else
+    {
+        memset(d->transitions, -1, (size_t)d->count * d->nfa->width * sizeof(int));
+    }
+    memset(d->table, -1, d->tableSize * sizeof(int));
+    d->count = 0;
+    d->keysCount = 0;
+    memset(d->starts, -1, sizeof(d->starts));
+    ++d->flushes;
+}
+
+/*
+    Returns the state with the key, that is built in d->buffer, adding it if needed.
+
+If the cache would outgrow d->limit, it is flushed first. Returns -1 if the state doesn't fit even
+in the empty cache.
+*/
+static int dfaState(re_dfa *d, int length)
+{
+    unsigned int mask = d->tableSize - 1;
+    unsigned int slot = hashKey(d->buffer, length) & mask;
+    while (d->table[slot] != -1)
+    {
+        int s = d->table[slot];
+        if (d->keyOffsets[s + 1] - d->keyOffsets[s] == length && memcmp(d->keys + d->keyOffsets[s], d->buffer, length * sizeof(int)) == 0)
+        {
+            return s;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    // sizes of arrays after the state is added, the load of the table is kept below one half
+    int capacity = d->count < d->capacity ? d->capacity : (d->capacity ? d->capacity * 2 : 16);
+    int keysCapacity = d->keysCapacity ? d->keysCapacity : 256;
+    while (d->keysCount + length > keysCapacity)
+    {
+        keysCapacity *= 2;
+    }
+    int tableSize = d->tableSize;
+    while ((d->count + 1) * 2 > tableSize)
+    {
+        tableSize *= 2;
+    }
+
+    size_t memory = dfaFootprint(d, capacity, keysCapacity, tableSize);
+    if (memory > d->memory && memory > d->limit)
+    {
+        if (d->count == 0)
+        {
+            return -1;
+        }
+        dfaFlush(d);
+        return dfaState(d, length);
+    }
+    d->memory = memory > d->memory ? memory : d->memory;
+
+    if (capacity != d->capacity)
+    {
+        size_t width = d->nfa->width;
+        d->transitions = (int *)realloc(d->transitions, (size_t)capacity * width * sizeof(int));
+        memset(d->transitions + (size_t)d->capacity * width, -1, (size_t)(capacity - d->capacity) * width * sizeof(int));
+        d->flags = (unsigned char *)realloc(d->flags, capacity);
+        d->keyOffsets = (int *)realloc(d->keyOffsets, (capacity + 1) * sizeof(int));
+        d->capacity = capacity;
+    }
+    if (keysCapacity != d->keysCapacity)
+    {
+        d->keys = (int *)realloc(d->keys, keysCapacity * sizeof(int));
+        d->keysCapacity = keysCapacity;
+    }
+
+    int s = d->count++;
+    memcpy(d->keys + d->keysCount, d->buffer, length * sizeof(int));
+    d->keysCount += length;
+    d->keyOffsets[s + 1] = d->keysCount;
+    d->flags[s] = (unsigned char)d->buffer[0];
+    d->table[slot] = s;
+
+    if (tableSize != d->tableSize)
+    {
+        free(d->table);
+        d->tableSize = tableSize;
+        d->table = (int *)malloc(d->tableSize * sizeof(int));
+        memset(d->table, -1, d->tableSize * sizeof(int));
+        mask = d->tableSize - 1;
+        for (int i = 0; i < d->count; i++)
+        {
+            slot = hashKey(d->keys + d->keyOffsets[i], d->keyOffsets[i + 1] - d->keyOffsets[i]) & mask;
+            while (d->table[slot] != -1)
+            {
+                slot = (slot + 1) & mask;
+            }
+            d->table[slot] = i;
+        }
+    }
+
+    return s;
+}
+
+static int compareNodes(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static void dfaPush(re_dfa *d, int node, int *top)
+{
+    if (d->marks[node] != d->generation)
+    {
+        d->marks[node] = d->generation;
+        d->stack[(*top)++] = node;
+    }
+}
+
+/*
+    Appends the group of nodes, that are reachable from the stacked nodes by epsilon transitions.
+
+Nodes, that were visited in this generation, belong to the earlier group and are skipped.
+Only nodes with byte transitions and the final node are stored in the group.
+*/
+static void dfaClosure(re_dfa *d, int top, int *length)
+{
+    re_automata *nfa = d->nfa;
+    int group = (*length)++;
+
+    while (top > 0)
+    {
+        int n = d->stack[--top];
+        bool stored = n == nfa->accept;
+        for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1]; t++)
+        {
+            if (nfa->transitions[t].label == RE_EPSILON)
+            {
+                dfaPush(d, nfa->transitions[t].target, &top);
+            }
+            else
+            {
+                stored = true;
+            }
+        }
+        if (stored)
+        {
+            d->buffer[(*length)++] = n;
+        }
+    }
+
+    d->buffer[group] = *length - group - 1;
+    if (d->buffer[group] == 0)
+    {
+        --(*length); // empty groups are dropped
+    }
+    else
+    {
+        qsort(d->buffer + group + 1, d->buffer[group], sizeof(int), compareNodes);
+    }
+}
+
+/*
+    Returns the context of assertions after the byte previous, -1 stands for the start of the string.
+Only the context, that assertions of the automata look at, is kept, so other states aren't split.
+*/
+static int dfaContext(re_dfa *d, int previous)
+{
+    int looks = d->nfa->looks, context = 0;
+    if (previous < 0)
+    {
+        return looks & (RE_LOOK_TEXT_START | RE_LOOK_LINE_START) ? RE_STATE_AT_START : 0;
+    }
+    if (looks & RE_LOOK_LINE_START && previous == '\n')
+    {
+        context |= RE_STATE_AFTER_NEWLINE;
+    }
+    if (looks & (RE_LOOK_WORD | RE_LOOK_NOT_WORD) && d->nfa->words[previous >> 3] & (1 << (previous & 7)))
+    {
+        context |= RE_STATE_AFTER_WORD;
+    }
+    return context;
+}
+
+/*
+    Checks the assertion between the byte before the state with the context and the byte c.
+*/
+static bool dfaAssertion(re_dfa *d, int look, int context, int c)
+{
+    bool word = c != RE_END_OF_INPUT && d->nfa->words[c >> 3] & (1 << (c & 7));
+    bool afterWord = context & RE_STATE_AFTER_WORD;
+    switch (look)
+    {
+    case RE_LOOK_TEXT_START:
+        return context & RE_STATE_AT_START;
+    case RE_LOOK_LINE_START:
+        return context & (RE_STATE_AT_START | RE_STATE_AFTER_NEWLINE);
+    case RE_LOOK_TEXT_END:
+        return c == RE_END_OF_INPUT;
+    case RE_LOOK_LINE_END:
+        return c == RE_END_OF_INPUT || c == '\n';
+    case RE_LOOK_WORD:
+        return afterWord != word;
+
+    default: // RE_LOOK_NOT_WORD
+        return afterWord == word;
+    }
+}
+
+/*
+    Expands the group of nodes by transitions of the assertions, that hold before the byte c,
+and by epsilon transitions behind them. Returns the number of nodes in d->expanded.
+*/
+static int dfaExpand(re_dfa *d, const int *nodes, int count, int context, int c)
+{
+    re_automata *nfa = d->nfa;
+    int expansion = ++d->expansions, length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        d->passed[nodes[i]] = expansion;
+        d->expanded[length++] = nodes[i];
+    }
+    for (int i = 0; i < length; i++)
+    {
+        int n = d->expanded[i];
+        for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1]; t++)
+        {
+            int label = nfa->transitions[t].label, m = nfa->transitions[t].target;
+            bool passes = label == RE_EPSILON || (label < RE_EPSILON && dfaAssertion(d, RE_LABEL_LOOK(label), context, c));
+            if (passes && d->passed[m] != expansion)
+            {
+                d->passed[m] = expansion;
+                d->expanded[length++] = m;
+            }
+        }
+    }
+    return length;
+}
+
+/*
+    Returns the initial state for the context of the byte previous, -1 stands for the start of the string.
+*/
+static int dfaStart(re_dfa *d, int previous)
+{
+    int context = dfaContext(d, previous);
+    int *start = &d->starts[context / RE_STATE_AT_START];
+    if (*start < 0)
+    {
+        int length = 1, top = 0;
+        ++d->generation;
+        dfaPush(d, d->nfa->start, &top);
+        dfaClosure(d, top, &length);
+        d->buffer[0] = (d->kind & RE_DFA_ANCHORED ? 0 : RE_STATE_INJECT) | context;
+        if (length == 1 && !(d->buffer[0] & RE_STATE_INJECT))
+        {
+            d->buffer[0] = RE_STATE_DEAD;
+        }
+        int s = dfaState(d, length);
+        if (s >= 0)
+        {
+            d->flags[s] |= RE_STATE_START;
+        }
+        *start = s;
+    }
+    return *start;
+}
+
+/*
+    Computes the transition of the state s by the byte c or by RE_END_OF_INPUT.
+
+Returns -1 if the state doesn't fit in the memory limit.
+*/
+static int dfaStep(re_dfa *d, int s, int c)
+{
+    RE_STATS_MISS(d);
+    re_automata *nfa = d->nfa;
+    int *key = d->keys + d->keyOffsets[s];
+    int keyLength = d->keyOffsets[s + 1] - d->keyOffsets[s];
+    int flags = key[0] & RE_STATE_INJECT;
+
+    int length = 1, top = 0;
+    ++d->generation;
+    // the earliest group, that reaches the final node, ends the match: later groups are dropped
+    for (int g = 1; g < keyLength && !(flags & RE_STATE_MATCH); g += key[g] + 1)
+    {
+        const int *nodes = key + g + 1;
+        int count = key[g];
+        if (nfa->looks)
+        {
+            count = dfaExpand(d, nodes, count, key[0] & RE_STATE_CONTEXT, c);
+            nodes = d->expanded;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            int n = nodes[i];
+            if (n == nfa->accept)
+            {
+                flags = RE_STATE_MATCH;
+            }
+            for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1] && c != RE_END_OF_INPUT; t++)
+            {
+                int label = nfa->transitions[t].label;
+                if (label >= 0 && nfa->sets[label][c >> 3] & (1 << (c & 7)))
+                {
+                    dfaPush(d, nfa->transitions[t].target, &top);
+                }
+            }
+        }
+        if (d->kind & RE_DFA_LEFTMOST && c != RE_END_OF_INPUT)
+        {
+            dfaClosure(d, top, &length);
+            top = 0;
+        }
+    }
+
+    // only the new thread is left, so it is the initial state of the context after c
+    bool restarted = flags & RE_STATE_INJECT && length == 1 && top == 0;
+    if (c != RE_END_OF_INPUT)
+    {
+        if (flags & RE_STATE_INJECT)
+        {
+            dfaPush(d, nfa->start, &top);
+        }
+        dfaClosure(d, top, &length);
+        flags |= dfaContext(d, c);
+    }
+    else
+    {
+        flags &= ~RE_STATE_INJECT;
+    }
+
+    if (length == 1 && !(flags & RE_STATE_INJECT))
+    {
+        flags = (flags & RE_STATE_MATCH) | RE_STATE_DEAD;
+    }
+    d->buffer[0] = flags;
+
+    unsigned int flushes = d->flushes;
+    int t = dfaState(d, length);
+    if (t >= 0 && restarted && c != RE_END_OF_INPUT)
+    {
+        d->flags[t] |= RE_STATE_START;
+    }
+    if (t >= 0 && flushes == d->flushes)
+    {
+        d->transitions[(size_t)s * nfa->width + nfa->columns[c]] = t;
+    }
+    else if (t >= 0 && (dfaStart(d, -1) < 0 || flushes + 1 != d->flushes))
+    {
+        t = -1; // the cache is too small to hold both the initial and the new state
+    }
+    return t;
+}
+
+static int dfaNext(re_dfa *d, int s, int c)
+{
+    int t = d->transitions[(size_t)s * d->nfa->width + d->nfa->columns[c]];
+    return t >= 0 ? t : dfaStep(d, s, c);
+}
+
+/*
+    Finds the literal, that every match starts with, and checks if the whole pattern is literal.
+
+The prefix grows while all threads of the automata have to consume the same byte.
+*/
+static void findPrefix(re_regex *reg)
+{
+    re_automata *nfa = reg->forward;
+    int *marks = (int *)calloc(nfa->size, sizeof(int));
+    int *current = (int *)malloc(2 * nfa->size * sizeof(int));
+    int *next = (int *)malloc(2 * nfa->size * sizeof(int));
+    int count = 0, nextCount = 0;
+
+    reg->prefix = (unsigned char *)malloc(nfa->size);
+    reg->prefixLength = 0;
+    reg->literal = false;
+    reg->prefixFolded = false;
+
+    current[count++] = nfa->start;
+    for (int generation = 1;; generation++)
+    {
+        // epsilon closure of the current nodes, assertions are taken as holding
+        for (int i = 0; i < count; i++)
+        {
+            marks[current[i]] = generation;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            int n = current[i];
+            for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1]; t++)
+            {
+                int m = nfa->transitions[t].target;
+                if (nfa->transitions[t].label < 0 && marks[m] != generation)
+                {
+                    marks[m] = generation;
+                    current[count++] = m;
+                }
+            }
+        }
+
+        // every transition has to consume the same set: the only byte or,
+        // in case insensitive mode, the only letter in both cases
+        int label = -1, byte = -1;
+        bool single = true, final = false, folded = false;
+        nextCount = 0;
+        for (int i = 0; i < count && single; i++)
+        {
+            int n = current[i];
+            final = final || n == nfa->accept;
+            for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1] && single; t++)
+            {
+                if (nfa->transitions[t].label < 0)
+                {
+                    continue;
+                }
+                single = label == -1 || memcmp(nfa->sets[label], nfa->sets[nfa->transitions[t].label], 32) == 0;
+                label = nfa->transitions[t].label;
+                next[nextCount++] = nfa->transitions[t].target;
+            }
+        }
+        for (int c = 0; c < 256 && single && label != -1; c++)
+        {
+            if (nfa->sets[label][c >> 3] & (1 << (c & 7)))
+            {
+                folded = (reg->flags & RE_ICASE) && byte != -1 && byte == otherCase(c);
+                single = byte == -1 || folded;
+                byte = c; // lowercase follows uppercase
+            }
+        }
+        if (final || !single || byte == -1)
+        {
+            // the match can end only here and nothing else can be consumed, unless an assertion fails
+            reg->literal = final && single && byte == -1 && !nfa->looks;
+            break;
+        }
+        if (reg->prefixLength == nfa->size)
+        {
+            break; // a cycle, that never reaches the final node
+        }
+
+        reg->prefix[reg->prefixLength++] = (unsigned char)byte;
+        reg->prefixFolded = reg->prefixFolded || folded;
+        int *swap = current;
+        current = next;
+        next = swap;
+        count = nextCount;
+    }
+
+    free(marks);
+    free(current);
+    free(next);
+}
+
+/*
+    Computes the minimal and the maximal length of the match and the bytes, that it can start with.
+*/
+static void analyzeAutomata(re_regex *reg)
+{
+    re_automata *nfa = reg->forward;
+    int size = nfa->size;
+    int edges = nfa->offsets[size];
+
+    // minimal length: breadth first search, where epsilon transitions cost nothing
+    int *distance = (int *)malloc(size * sizeof(int));
+    int *deque = (int *)malloc((2 * (size + edges) + 1) * sizeof(int));
+    for (int n = 0; n < size; n++)
+    {
+        distance[n] = -1;
+    }
+    int head = size + edges, tail = head;
+    distance[nfa->start] = 0;
+    deque[tail++] = nfa->start;
+    while (head < tail)
+    {
+        int n = deque[head++];
+        for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1]; t++)
+        {
+            int m = nfa->transitions[t].target;
+            int cost = nfa->transitions[t].label < 0 ? 0 : 1;
+            if (distance[m] == -1 || distance[n] + cost < distance[m])
+            {
+                distance[m] = distance[n] + cost;
+                if (cost == 0)
+                {
+                    deque[--head] = m;
+                }
+                else
+                {
+                    deque[tail++] = m;
+                }
+            }
+        }
+    }
+    reg->minLength = distance[nfa->accept] < 0 ? 0 : distance[nfa->accept];
+
+    // maximal length: the longest path in topological order of nodes, that lead to the final node;
+    // a cycle among them means, that the length is unbounded
+    bool *useful = (bool *)calloc(size, sizeof(bool));
+    int *incoming = (int *)calloc(size, sizeof(int));
+    re_automata *backward = reg->backward; // the same nodes with reversed transitions
+    head = tail = 0;
+    useful[nfa->accept] = true;
+    deque[tail++] = nfa->accept;
+    while (head < tail)
+    {
+        int n = deque[head++];
+        for (int t = backward->offsets[n]; t < backward->offsets[n + 1]; t++)
+        {
+            int m = backward->transitions[t].target;
+            if (!useful[m] && distance[m] >= 0)
+            {
+                useful[m] = true;
+                deque[tail++] = m;
+            }
+        }
+    }
+    for (int n = 0; n < size; n++)
+    {
+        for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1] && useful[n]; t++)
+        {
+            incoming[nfa->transitions[t].target] += useful[nfa->transitions[t].target];
+        }
+        distance[n] = 0;
+    }
+    head = tail = 0;
+    for (int n = 0; n < size; n++)
+    {
+        if (useful[n] && incoming[n] == 0)
+        {
+            deque[tail++] = n;
+        }
+    }
+    while (head < tail)
+    {
+        int n = deque[head++];
+        for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1]; t++)
+        {
+            int m = nfa->transitions[t].target;
+            if (!useful[m])
+            {
+                continue;
+            }
+            int length = distance[n] + (nfa->transitions[t].label < 0 ? 0 : 1);
+            distance[m] = length > distance[m] ? length : distance[m];
+            if (--incoming[m] == 0)
+            {
+                deque[tail++] = m;
+            }
+        }
+    }
+    int usefulCount = 0;
+    for (int n = 0; n < size; n++)
+    {
+        usefulCount += useful[n];
+    }
+    reg->maxLength = tail < usefulCount ? RE_UNBOUNDED : (size_t)distance[nfa->accept];
+
+    // first bytes: transitions of the nodes, that are reachable from the initial one without consuming
+    memset(reg->firstBytes, 0, sizeof(reg->firstBytes));
+    head = tail = 0;
+    memset(useful, 0, size * sizeof(bool));
+    useful[nfa->start] = true;
+    deque[tail++] = nfa->start;
+    while (head < tail)
+    {
+        int n = deque[head++];
+        for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1]; t++)
+        {
+            int label = nfa->transitions[t].label;
+            if (label >= 0)
+            {
+                for (int c = 0; c < 256; c++)
+                {
+                    reg->firstBytes[c] |= (nfa->sets[label][c >> 3] >> (c & 7)) & 1;
+                }
+            }
+            else if (!useful[nfa->transitions[t].target])
+            {
+                useful[nfa->transitions[t].target] = true;
+                deque[tail++] = nfa->transitions[t].target;
+            }
+        }
+    }
+
+    // anchoring: every path from the initial node starts with ^, before anything is consumed
+    int looks = 0;
+    bool anchored = true;
+    head = tail = 0;
+    memset(useful, 0, size * sizeof(bool));
+    useful[nfa->start] = true;
+    deque[tail++] = nfa->start;
+    while (head < tail && anchored)
+    {
+        int n = deque[head++];
+        for (int t = nfa->offsets[n]; t < nfa->offsets[n + 1]; t++)
+        {
+            int label = nfa->transitions[t].label, m = nfa->transitions[t].target;
+            if (label != RE_EPSILON)
+            {
+                looks |= label < 0 ? RE_LABEL_LOOK(label) : 0;
+                anchored = anchored && label < 0 && RE_LABEL_LOOK(label) & (RE_LOOK_TEXT_START | RE_LOOK_LINE_START);
+            }
+            else if (!useful[m])
+            {
+                useful[m] = true;
+                deque[tail++] = m;
+            }
+        }
+    }
+    anchored = anchored && !useful[nfa->accept];
+    reg->anchoring = !anchored || looks == 0 ? RE_ANCHOR_NONE : looks == RE_LOOK_TEXT_START ? RE_ANCHOR_TEXT : RE_ANCHOR_LINE;
+
+    free(distance);
+    free(deque);
+    free(useful);
+    free(incoming);
+}
+
+/*
+    Returns the first position in [from, length), where the match can start, or length.
+
+It is used, when no thread of the automata is alive: the match has to start with the literal prefix,
+at the start of a line or at least with one of the first bytes, and it needs minLength bytes.
+*/
+static size_t skipStart(re_regex *reg, const unsigned char *text, size_t from, size_t length)
+{
+    if (length - from < reg->minLength)
+    {
+        return length;
+    }
+    if (reg->prefilter == RE_PREFILTER_PREFIX)
+    {
+        const unsigned char *found = scanPrefix(reg, text + from, text + length);
+        return found != NULL ? (size_t)(found - text) : length;
+    }
+    if (reg->prefilter == RE_PREFILTER_LINE_START)
+    {
+        if (from > 0 && text[from - 1] != '\n')
+        {
+            // memchr finds the next '\n' faster than the automata reads the line
+            const unsigned char *newline = (const unsigned char *)memchr(text + from, '\n', length - from);
+            from = newline != NULL ? (size_t)(newline - text) + 1 : length;
+        }
+        return length - from < reg->minLength ? length : from;
+    }
+    while (from < length && !reg->firstBytes[text[from]])
+    {
+        ++from;
+    }
+    return length - from < reg->minLength ? length : from;
+}
+
+static unsigned char otherCase(unsigned char c)
+{
+    if (c >= 'A' && c <= 'Z')
+    {
+        return c + ('a' - 'A');
+    }
+    if (c >= 'a' && c <= 'z')
+    {
+        return c - ('a' - 'A');
+    }
+    return c;
+}
+
+/*
+    Returns the first occurrence of the lowercase prefix ignoring ascii case in [from, to) or NULL.
+
+Both cases of the first byte are searched with memchr, the nearest candidate is compared with folding.
+*/
+static const unsigned char *scanFolded(re_regex *reg, const unsigned char *from, const unsigned char *to)
+{
+    if (to - from < reg->prefixLength)
+    {
+        return NULL;
+    }
+    const unsigned char *last = to - reg->prefixLength + 1; // candidates are in [from, last)
+    unsigned char first = reg->prefix[0];
+    const unsigned char *lower = (const unsigned char *)memchr(from, first, last - from);
+    const unsigned char *upper = otherCase(first) == first ? NULL : (const unsigned char *)memchr(from, otherCase(first), last - from);
+    while (lower != NULL || upper != NULL)
+    {
+        const unsigned char *candidate = upper == NULL || (lower != NULL && lower < upper) ? lower : upper;
+        int i = 1;
+        while (i < reg->prefixLength && (candidate[i] == reg->prefix[i] || otherCase(candidate[i]) == reg->prefix[i]))
+        {
+            ++i;
+        }
+        if (i == reg->prefixLength)
+        {
+            return candidate;
+        }
+
+        if (candidate == lower)
+        {
+            lower = (const unsigned char *)memchr(candidate + 1, first, last - candidate - 1);
+        }
+        else
+        {
+            upper = (const unsigned char *)memchr(candidate + 1, otherCase(first), last - candidate - 1);
+        }
+    }
+    return NULL;
+}
+
+/*
+    Returns the first occurrence of the literal prefix in [from, to) or NULL.
+*/
+static const unsigned char *scanPrefix(re_regex *reg, const unsigned char *from, const unsigned char *to)
+{
+    if (reg->prefixFolded)
+    {
+        return scanFolded(reg, from, to);
+    }
+    while (to - from >= reg->prefixLength)
+    {
+        from = (const unsigned char *)memchr(from, reg->prefix[0], to - from - reg->prefixLength + 1);
+        if (from == NULL)
+        {
+            return NULL;
+        }
+        if (memcmp(from + 1, reg->prefix + 1, reg->prefixLength - 1) == 0)
+        {
+            return from;
+        }
+        ++from;
+    }
+    return NULL;
+}
+
+/*
+    Prepares the states for capturing: their bytes or codepoints and, if the next byte always determines
+the next state, the table of successors for the one pass.
+
+Arguments:
+ambiguous - an edge leaves or enters different groups depending on the path
+*/
+static void analyzeGroups(re_regex *reg, bool ambiguous)
+{
+    int size = reg->size;
+    if (reg->groups == 0)
+    {
+        return; // the span of the match is all, that re_captures reports
+    }
+    if (reg->flags & RE_UTF8)
+    {
+        // the one pass works on bytes, utf-8 patterns always run all threads
+        re_range buffer[RE_MAX_CLASS_RANGES];
+        reg->rangeOffsets = (int *)calloc(size + 2, sizeof(int));
+        for (int k = 1; k <= size; k++)
+        {
+            int count = codepointRanges(&reg->states[k], buffer, reg->classes, reg->flags & RE_ICASE);
+            reg->rangeOffsets[k + 1] = reg->rangeOffsets[k] + count;
+            reg->ranges = (re_range *)realloc(reg->ranges, (reg->rangeOffsets[k + 1] + 1) * sizeof(re_range));
+            memcpy(reg->ranges + reg->rangeOffsets[k], buffer, count * sizeof(re_range));
+        }
+        return;
+    }
+
+    reg->bytes = (unsigned char(*)[32])calloc(size + 1, sizeof(*reg->bytes));
+    for (int k = 1; k <= size; k++)
+    {
+        collectBytes(reg, &reg->states[k], reg->bytes[k]);
+    }
+
+    // bytes of successors can't intersect with each other and with the repetition of the state,
+    // and assertions depend on bytes around the state, so they need all threads
+    reg->onepass = !ambiguous && reg->forward->looks == 0;
+    reg->successors = (short(*)[256])malloc((size + 1) * sizeof(*reg->successors));
+    for (int j = 0; j <= size && reg->onepass; j++)
+    {
+        unsigned char taken[32] = {0};
+        if (j > 0 && reg->states[j].min < reg->states[j].max)
+        {
+            memcpy(taken, reg->bytes[j], sizeof(taken));
+        }
+        for (int c = 0; c < 256; c++)
+        {
+            reg->successors[j][c] = -1;
+        }
+        for (int k = 1; k <= size && reg->onepass; k++)
+        {
+            for (int c = 0; c < 256 && reg->nfa[j][k]; c++)
+            {
+                if (reg->bytes[k][c >> 3] & (1 << (c & 7)))
+                {
+                    reg->onepass = reg->onepass && !(taken[c >> 3] & (1 << (c & 7)));
+                    taken[c >> 3] |= 1 << (c & 7);
+                    reg->successors[j][c] = k;
+                }
+            }
+        }
+    }
+    if (!reg->onepass)
+    {
+        free(reg->successors);
+        reg->successors = NULL;
+    }
+}
+
+/*
+    Moves from the state j to the state k at the position: groups of j and groups of k, that are deeper
+than the node of the edge, are left and entered, groups between them match the empty string there.
+k is -1 at the end of the match.
+
+Arguments:
+captures - start and end of every group
+*/
+static void crossEdge(re_regex *reg, int j, int k, int position, int *captures)
+{
+    int depth = k >= 0 ? reg->edgeDepth[j][k] : -1;
+    for (int m = reg->memberOffsets[j]; m < reg->memberOffsets[j + 1]; m++)
+    {
+        if (reg->members[m].depth > depth)
+        {
+            captures[2 * reg->members[m].group + 1] = position;
+        }
+    }
+    int set = reg->skips != NULL ? reg->skips[j][k >= 0 ? k : 0] : 0;
+    for (int g = reg->skipOffsets[set]; g < reg->skipOffsets[set + 1]; g++)
+    {
+        captures[2 * reg->skipGroups[g]] = position;
+        captures[2 * reg->skipGroups[g] + 1] = position;
+    }
+    for (int m = k >= 0 ? reg->memberOffsets[k] : 0; k >= 0 && m < reg->memberOffsets[k + 1]; m++)
+    {
+        if (reg->members[m].depth > depth)
+        {
+            captures[2 * reg->members[m].group] = position;
+            captures[2 * reg->members[m].group + 1] = -1;
+        }
+    }
+}
+
+/*
+    Follows the only thread over the match [start, end), returns false if it dies.
+*/
+static bool onepassCaptures(re_regex *reg, const unsigned char *text, int start, int end, int *captures)
+{
+    int j = 0, count = 0; // state and number of its repetitions
+    for (int i = start; i < end; i++)
+    {
+        re_state *st = &reg->states[j];
+        bool own = j > 0 && (reg->bytes[j][text[i] >> 3] & (1 << (text[i] & 7)));
+        if (j > 0 && count < st->min)
+        {
+            if (!own)
+            {
+                return false;
+            }
+            ++count;
+            continue;
+        }
+        if (own && (st->max == RE_INFINITY_REPETITIONS || count < st->max))
+        {
+            count += st->max != RE_INFINITY_REPETITIONS; // all counts from min are the same for a loop
+            continue;
+        }
+
+        int k = reg->successors[j][text[i]];
+        if (k < 0)
+        {
+            return false;
+        }
+        crossEdge(reg, j, k, i, captures);
+        j = k;
+        count = 1;
+    }
+    if (!reg->finals[j] || (j > 0 && count < reg->states[j].min))
+    {
+        return false;
+    }
+    crossEdge(reg, j, -1, end, captures);
+    return true;
+}
+
+static bool acceptsSymbol(re_regex *reg, int k, unsigned int symbol)
+{
+    if (reg->bytes != NULL)
+    {
+        return reg->bytes[k][symbol >> 3] & (1 << (symbol & 7));
+    }
+
+    int low = reg->rangeOffsets[k], high = reg->rangeOffsets[k + 1];
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (reg->ranges[middle].finish < symbol)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low < reg->rangeOffsets[k + 1] && reg->ranges[low].start <= symbol;
+}
+
+/*
+    Threads of the captures search in the order of their priority.
+*/
+typedef struct re_threads
+{
+    int *states;
+    int *counts;   // repetitions of the state
+    int *captures; // width numbers per thread
+    int size;
+} re_threads;
+
+/*
+    Adds the thread, unless a thread of higher priority is in the same state with the same count.
+Returns captures of the new thread or NULL.
+*/
+static int *addThread(re_threads *list, int j, int count, const int *captures, int width, int *marks, int index, int generation)
+{
+    if (marks[index] == generation)
+    {
+        return NULL;
+    }
+    marks[index] = generation;
+    list->states[list->size] = j;
+    list->counts[list->size] = count;
+    int *copy = list->captures + (size_t)list->size++ * width;
+    memcpy(copy, captures, width * sizeof(int));
+    return copy;
+}
+
+/*
+    Checks the assertion at the position of the text, bytes outside of the text are not word bytes.
+*/
+static bool assertionHolds(re_regex *reg, int look, const unsigned char *text, size_t length, size_t position)
+{
+    bool before = position > 0 && reg->classes[text[position - 1]] & RE_CLASS_WORD;
+    bool after = position < length && reg->classes[text[position]] & RE_CLASS_WORD;
+    switch (look)
+    {
+    case RE_LOOK_TEXT_START:
+        return position == 0;
+    case RE_LOOK_LINE_START:
+        return position == 0 || text[position - 1] == '\n';
+    case RE_LOOK_TEXT_END:
+        return position == length;
+    case RE_LOOK_LINE_END:
+        return position == length || text[position] == '\n';
+    case RE_LOOK_WORD:
+        return before != after;
+
+    default: // RE_LOOK_NOT_WORD
+        return before == after;
+    }
+}
+
+/*
+    Step of the captures search: the list of the next threads and assertions, that are crossed
+without consuming a symbol.
+
+crossing - assertions on the current path, so a loop of assertions is crossed once
+scratch - captures after every crossed assertion of the path, width numbers per assertion
+*/
+typedef struct re_pike_step
+{
+    re_threads *next;
+    int *marks;
+    const int *base;
+    int generation;
+    int width;
+    bool *crossing;
+    int *scratch;
+} re_pike_step;
+
+/*
+    Moves the thread from the state j to its successors, that accept the symbol at i, in the order
+of their numbers. Successors, that are assertions holding at i, pass the thread on to their own ones.
+*/
+static void advanceThread(re_regex *reg, re_pike_step *step, int j, int count, const unsigned char *text, size_t length, int i, unsigned int symbol, const int *from, int depth)
+{
+    for (int k = 1; k <= reg->size && (j == 0 || count >= reg->states[j].min); k++)
+    {
+        if (!reg->nfa[j][k])
+        {
+            continue;
+        }
+        if (reg->states[k].type == RE_ASSERTION)
+        {
+            if (!step->crossing[k] && assertionHolds(reg, reg->states[k].symbols[0].value.element, text, length, i))
+            {
+                int *crossed = step->scratch + (size_t)depth * step->width;
+                memcpy(crossed, from, step->width * sizeof(int));
+                crossEdge(reg, j, k, i, crossed);
+                step->crossing[k] = true;
+                advanceThread(reg, step, k, 1, text, length, i, symbol, crossed, depth + 1);
+                step->crossing[k] = false;
+            }
+        }
+        else if (acceptsSymbol(reg, k, symbol))
+        {
+            int *to = addThread(step->next, k, 1, from, step->width, step->marks, step->base[k] + 1, step->generation);
+            if (to != NULL)
+            {
+                crossEdge(reg, j, k, i, to);
+            }
+        }
+    }
+}
+
+/*
+    Ends the thread in the state j at the end of the match, directly or over assertions, that hold there.
+Returns true and fills captures if it reaches a final state.
+*/
+static bool finishThread(re_regex *reg, re_pike_step *step, int j, int count, const unsigned char *text, size_t length, int end, const int *from, int depth, int *captures)
+{
+    if (j > 0 && count < reg->states[j].min)
+    {
+        return false;
+    }
+    if (reg->finals[j])
+    {
+        memcpy(captures, from, step->width * sizeof(int));
+        crossEdge(reg, j, -1, end, captures);
+        return true;
+    }
+    for (int k = 1; k <= reg->size; k++)
+    {
+        if (reg->nfa[j][k] && reg->states[k].type == RE_ASSERTION && !step->crossing[k] &&
+            assertionHolds(reg, reg->states[k].symbols[0].value.element, text, length, end))
+        {
+            int *crossed = step->scratch + (size_t)depth * step->width;
+            memcpy(crossed, from, step->width * sizeof(int));
+            crossEdge(reg, j, k, end, crossed);
+            step->crossing[k] = true;
+            bool finished = finishThread(reg, step, k, 1, text, length, end, crossed, depth + 1, captures);
+            step->crossing[k] = false;
+            if (finished)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+    Runs all threads over the match [start, end) in the order of their priority: repetitions first,
+then successors by their numbers. Captures of the first thread, that ends in a final state, are taken.
+*/
+static void pikeCaptures(re_regex *reg, const unsigned char *text, size_t length, int start, int end, int *captures)
+{
+    int size = reg->size, width = 2 * (reg->groups + 1);
+
+    // configurations are states with counts, counts above min of a loop are the same
+    int *base = (int *)malloc((size + 1) * sizeof(int));
+    int configurations = 1;
+    for (int k = 1; k <= size; k++)
+    {
+        re_state *st = &reg->states[k];
+        base[k] = configurations - 1;
+        configurations += st->max == RE_INFINITY_REPETITIONS ? st->min : st->max;
+    }
+    int *marks = (int *)calloc(configurations, sizeof(int));
+    re_threads lists[2];
+    for (int l = 0; l < 2; l++)
+    {
+        lists[l].states = (int *)malloc(configurations * sizeof(int));
+        lists[l].counts = (int *)malloc(configurations * sizeof(int));
+        lists[l].captures = (int *)malloc((size_t)configurations * width * sizeof(int));
+        lists[l].size = 0;
+    }
+    re_pike_step step = {NULL, marks, base, 1, width, (bool *)calloc(size + 1, sizeof(bool)),
+                     (int *)malloc((size_t)(size + 1) * width * sizeof(int))};
+
+    re_threads *current = &lists[0], *next = &lists[1];
+    addThread(current, 0, 0, captures, width, marks, 0, 1);
+    bool utf8 = reg->flags & RE_UTF8;
+    for (int i = start; i < end && current->size > 0;)
+    {
+        unsigned int symbolLength;
+        unsigned int symbol = readSymbol((const char *)text + i, length - i, utf8, &symbolLength);
+        ++step.generation;
+        step.next = next;
+        next->size = 0;
+        for (int t = 0; t < current->size; t++)
+        {
+            int j = current->states[t], count = current->counts[t];
+            int *from = current->captures + (size_t)t * width;
+            re_state *st = &reg->states[j];
+            if (j > 0 && (st->max == RE_INFINITY_REPETITIONS || count < st->max) && acceptsSymbol(reg, j, symbol))
+            {
+                int cap = st->max == RE_INFINITY_REPETITIONS ? st->min : st->max;
+                int repeated = count < cap ? count + 1 : count;
+                addThread(next, j, repeated, from, width, marks, base[j] + repeated, step.generation);
+            }
+            advanceThread(reg, &step, j, count, text, length, i, symbol, from, 0);
+        }
+
+        re_threads *swap = current;
+        current = next;
+        next = swap;
+        i += symbolLength;
+    }
+
+    for (int t = 0; t < current->size; t++)
+    {
+        int *from = current->captures + (size_t)t * width;
+        if (finishThread(reg, &step, current->states[t], current->counts[t], text, length, end, from, 0, captures))
+        {
+            break;
+        }
+    }
+
+    for (int l = 0; l < 2; l++)
+    {
+        free(lists[l].states);
+        free(lists[l].counts);
+        free(lists[l].captures);
+    }
+    free(step.crossing);
+    free(step.scratch);
+    free(marks);
+    free(base);
+}
+
+/*
+    Fills captures for the match [start, end) with the engine of the plan.
+
+Arguments:
+captures - start and end of the match and of every group, -1 for groups, that don't take part in it
+*/
+static void findCaptures(re_regex *reg, const unsigned char *text, size_t length, int start, int end, int *captures)
+{
+    int width = 2 * (reg->groups + 1);
+    for (int i = 0; i < width; i++)
+    {
+        captures[i] = -1;
+    }
+    if (reg->capturing == RE_CAPTURES_THREADS ||
+        (reg->capturing == RE_CAPTURES_ONEPASS && !onepassCaptures(reg, text, start, end, captures)))
+    {
+        for (int i = 0; i < width; i++)
+        {
+            captures[i] = -1;
+        }
+        pikeCaptures(reg, text, length, start, end, captures);
+    }
+    captures[0] = start;
+    captures[1] = end;
+}
+
+/*
+    Chooses the prefilter and the engines of the pattern: a literal is found by a scan alone,
+the prefix or the first bytes are used only when they can skip something,
+and captures take the single thread, when the next byte always determines the state.
+*/
+static void planMatching(re_regex *reg)
+{
+    int firstBytes = 0;
+    for (int c = 0; c < 256; c++)
+    {
+        firstBytes += reg->firstBytes[c] != 0;
+    }
+    if (reg->anchoring == RE_ANCHOR_TEXT)
+    {
+        reg->prefilter = RE_PREFILTER_NONE; // the search dfa doesn't start threads after the first byte
+    }
+    else if (reg->prefixLength > 0)
+    {
+        reg->prefilter = RE_PREFILTER_PREFIX;
+    }
+    else if (reg->anchoring == RE_ANCHOR_LINE && reg->minLength > 0)
+    {
+        reg->prefilter = RE_PREFILTER_LINE_START; // the empty match at the end of the text isn't skipped to
+    }
+    else if (reg->minLength > 0 && firstBytes < 128)
+    {
+        reg->prefilter = RE_PREFILTER_FIRST_BYTES; // otherwise the check costs more than it skips
+    }
+    else
+    {
+        reg->prefilter = RE_PREFILTER_NONE;
+    }
+
+    reg->engine = reg->literal && reg->prefixLength > 0 ? RE_ENGINE_LITERAL : RE_ENGINE_DFA;
+
+    if (reg->groups == 0)
+    {
+        reg->capturing = RE_CAPTURES_NONE;
+    }
+    else
+    {
+        reg->capturing = reg->onepass ? RE_CAPTURES_ONEPASS : RE_CAPTURES_THREADS;
+    }
 }
 
 #undef CREGEX_IMPLEMENTATION
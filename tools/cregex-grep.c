@@ -0,0 +1,489 @@
+/*
+    cregex-grep: prints lines, that contain a match of the patterns.
+
+cc -O2 -pthread -Iinclude tools/cregex-grep.c -o cregex-grep
+
+Usage: cregex-grep [-c] [-o] [-n] [-i] [-u] [-j threads] (-e pattern)... | pattern [file]...
+
+-c - print the number of matching lines of every file
+-o - print only matches, every one on its own line
+-n - print the number of the line before it
+-i - ignore ascii case
+-u - utf-8 mode
+-j - number of threads, that share every file by lines
+-e - pattern, it can be repeated, lines match if any pattern matches
+
+Regular files are mapped into memory, others are read, no file or "-" stands for stdin.
+Exit status is 0 if some line matched, 1 if none did and 2 on errors, also when a search
+runs out of the memory of its dfa cache, then the output of that file stops before the line.
+*/
+#define _GNU_SOURCE
+#include "cregex.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct settings
+{
+    bool count;
+    bool only;
+    bool numbers;
+    bool names; // more than one file
+    int flags;
+    int threads;
+    const char **patterns;
+    int patternsCount;
+} settings;
+
+/*
+    Compiled patterns of one thread, caches of the automata can't be shared.
+All patterns are joined into one alternation, unless it doesn't fit the limits.
+*/
+typedef struct matcher
+{
+    re *patterns;
+    int count;
+} matcher;
+
+/*
+    Part of the file, that one thread processes, and its output.
+*/
+typedef struct job
+{
+    const settings *options;
+    matcher *m;
+    const char *name;
+    const char *start;
+    const char *end;
+    size_t firstLine; // number of the first line of the part from 1
+    size_t lines;     // lines in the part
+    size_t matched;   // matching lines
+    int error;        // RE_BUDGET_EXCEEDED or RE_TOO_LONG, that stopped the part, or 0
+    char *out;
+    size_t outLength;
+    size_t outCapacity;
+} job;
+
+bool compileMatcher(const settings *options, matcher *m)
+{
+    size_t length = 1;
+    for (int i = 0; i < options->patternsCount; i++)
+    {
+        length += strlen(options->patterns[i]) + 3;
+    }
+    char *joined = (char *)malloc(length);
+    joined[0] = '\0';
+    for (int i = 0; i < options->patternsCount; i++)
+    {
+        strcat(joined, i > 0 ? "|(" : "(");
+        strcat(joined, options->patterns[i]);
+        strcat(joined, ")");
+    }
+
+    m->patterns = (re *)calloc(options->patternsCount, sizeof(re));
+    m->count = 1;
+    m->patterns[0] = options->patternsCount > 1 ? re_compile_flags(joined, options->flags) : NULL;
+    free(joined);
+    if (m->patterns[0] != NULL)
+    {
+        return true;
+    }
+
+    m->count = options->patternsCount;
+    for (int i = 0; i < m->count; i++)
+    {
+        m->patterns[i] = re_compile_flags(options->patterns[i], options->flags);
+        if (m->patterns[i] == NULL)
+        {
+            fprintf(stderr, "cregex-grep: invalid pattern: %s\n", options->patterns[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+void freeMatcher(matcher *m)
+{
+    for (int i = 0; i < m->count; i++)
+    {
+        re_free(&m->patterns[i]);
+    }
+    free(m->patterns);
+}
+
+/*
+    Finds the leftmost-longest match of all patterns in the line from the offset, returns its start,
+RE_NOMATCH or the error of the search.
+*/
+int findMatch(matcher *m, const char *line, size_t length, size_t from, int *end)
+{
+    int first = RE_NOMATCH;
+    for (int i = 0; i < m->count; i++)
+    {
+        int e;
+        int s = re_search_from(&m->patterns[i], line, length, from, NULL, &e);
+        if (s < RE_NOMATCH)
+        {
+            return s;
+        }
+        if (s >= 0 && (first < 0 || s < first || (s == first && e > *end)))
+        {
+            first = s;
+            *end = e;
+        }
+    }
+    return first;
+}
+
+/*
+    Checks if any pattern matches the line, returns 1, 0 or RE_BUDGET_EXCEEDED.
+*/
+int lineMatches(matcher *m, const char *line, size_t length)
+{
+    for (int i = 0; i < m->count; i++)
+    {
+        int matches = re_test(&m->patterns[i], line, length, NULL);
+        if (matches != 0)
+        {
+            return matches;
+        }
+    }
+    return 0;
+}
+
+void append(job *j, const char *bytes, size_t count)
+{
+    if (j->outLength + count > j->outCapacity)
+    {
+        j->outCapacity = j->outCapacity > 0 ? j->outCapacity : 4096;
+        while (j->outLength + count > j->outCapacity)
+        {
+            j->outCapacity *= 2;
+        }
+        j->out = (char *)realloc(j->out, j->outCapacity);
+    }
+    memcpy(j->out + j->outLength, bytes, count);
+    j->outLength += count;
+}
+
+void appendPrefix(job *j, size_t line)
+{
+    if (j->options->names)
+    {
+        append(j, j->name, strlen(j->name));
+        append(j, ":", 1);
+    }
+    if (j->options->numbers)
+    {
+        char number[32];
+        append(j, number, snprintf(number, sizeof(number), "%zu:", line));
+    }
+}
+
+void *countLines(void *argument)
+{
+    job *j = (job *)argument;
+    for (const char *p = j->start; (p = memchr(p, '\n', j->end - p)) != NULL; p++)
+    {
+        ++j->lines;
+    }
+    return NULL;
+}
+
+void *processPart(void *argument)
+{
+    job *j = (job *)argument;
+    const settings *options = j->options;
+    size_t number = j->firstLine;
+    for (const char *line = j->start; line < j->end && j->error == 0; number++)
+    {
+        const char *newline = memchr(line, '\n', j->end - line);
+        const char *next = newline != NULL ? newline + 1 : j->end;
+        size_t length = (newline != NULL ? newline : j->end) - line;
+
+        if (options->only)
+        {
+            bool found = false;
+            for (size_t from = 0; from <= length;)
+            {
+                // the search goes on in the same line, so ^ and \b see the bytes before from
+                int end;
+                int start = findMatch(j->m, line, length, from, &end);
+                if (start < RE_NOMATCH)
+                {
+                    j->error = start;
+                }
+                if (start < 0)
+                {
+                    break;
+                }
+                if (end > start && !options->count)
+                {
+                    appendPrefix(j, number);
+                    append(j, line + start, end - start);
+                    append(j, "\n", 1);
+                }
+                found = found || end > start;
+                from = end > start ? end : start + 1;
+            }
+            j->matched += found;
+        }
+        else
+        {
+            int matches = lineMatches(j->m, line, length);
+            j->error = matches < 0 ? matches : 0;
+            if (matches == 1)
+            {
+                ++j->matched;
+                if (!options->count)
+                {
+                    appendPrefix(j, number);
+                    append(j, line, length);
+                    append(j, "\n", 1);
+                }
+            }
+        }
+        line = next;
+    }
+    return NULL;
+}
+
+/*
+    Splits the text into parts by lines and runs a thread per part, output is written in order.
+Returns the number of matching lines or -1, if a search failed, then the output stops at that line.
+*/
+long grepText(const settings *options, matcher *matchers, const char *name, const char *text, size_t size)
+{
+    int threads = options->threads;
+    job *jobs = (job *)calloc(threads, sizeof(job));
+    const char *start = text, *end = text + size;
+    for (int t = 0; t < threads; t++)
+    {
+        const char *finish = t == threads - 1 ? end : start + (end - start) / (threads - t);
+        const char *newline = finish < end ? memchr(finish, '\n', end - finish) : NULL;
+        finish = newline != NULL ? newline + 1 : end;
+
+        jobs[t].options = options;
+        jobs[t].firstLine = 1;
+        jobs[t].m = &matchers[t];
+        jobs[t].name = name;
+        jobs[t].start = start;
+        jobs[t].end = finish;
+        start = finish;
+    }
+
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    for (int pass = options->numbers && threads > 1 ? 0 : 1; pass < 2; pass++)
+    {
+        // the first pass counts lines of the parts to number lines of the second one
+        void *(*work)(void *) = pass == 0 ? countLines : processPart;
+        for (int t = 1; t < threads; t++)
+        {
+            pthread_create(&ids[t], NULL, work, &jobs[t]);
+        }
+        work(&jobs[0]);
+        for (int t = 1; t < threads; t++)
+        {
+            pthread_join(ids[t], NULL);
+        }
+        for (int t = 1; pass == 0 && t < threads; t++)
+        {
+            jobs[t].firstLine = jobs[t - 1].firstLine + jobs[t - 1].lines;
+        }
+    }
+
+    size_t matched = 0;
+    int error = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        if (error == 0)
+        {
+            fwrite(jobs[t].out, 1, jobs[t].outLength, stdout);
+            matched += jobs[t].matched;
+            error = jobs[t].error;
+        }
+        free(jobs[t].out);
+    }
+    if (error != 0)
+    {
+        fflush(stdout);
+        fprintf(stderr, "cregex-grep: %s: %s\n", name,
+                error == RE_TOO_LONG ? "a line is longer than INT_MAX bytes" : "a dfa state doesn't fit in its memory limit");
+    }
+    else if (options->count)
+    {
+        if (options->names)
+        {
+            printf("%s:", name);
+        }
+        printf("%zu\n", matched);
+    }
+    free(ids);
+    free(jobs);
+    return error != 0 ? -1 : (long)matched;
+}
+
+/*
+    Reads the file descriptor to its end into a buffer, that is allocated with malloc, returns NULL on errors.
+*/
+char *readAll(int fd, size_t *size)
+{
+    size_t capacity = 1 << 16;
+    char *text = (char *)malloc(capacity);
+    ssize_t got;
+    *size = 0;
+    while ((got = read(fd, text + *size, capacity - *size)) > 0)
+    {
+        *size += got;
+        if (*size == capacity)
+        {
+            capacity *= 2;
+            text = (char *)realloc(text, capacity);
+        }
+    }
+    if (got < 0)
+    {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/*
+    Maps the file or reads stdin and greps it, returns the number of matching lines or -1.
+Pipes and files without a size, like ones of /proc, are read like stdin.
+*/
+long grepFile(const settings *options, matcher *matchers, const char *name)
+{
+    bool standard = strcmp(name, "-") == 0;
+    int fd = standard ? STDIN_FILENO : open(name, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0)
+    {
+        perror(name);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    size_t size = (size_t)info.st_size;
+    if (standard || !S_ISREG(info.st_mode) || size == 0)
+    {
+        char *text = readAll(fd, &size);
+        if (!standard)
+        {
+            close(fd);
+        }
+        if (text == NULL)
+        {
+            perror(name);
+            return -1;
+        }
+        long matched = grepText(options, matchers, standard ? "(standard input)" : name, text, size);
+        free(text);
+        return matched;
+    }
+
+    char *text = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        perror(name);
+        return -1;
+    }
+    madvise(text, size, MADV_SEQUENTIAL);
+
+    long matched = grepText(options, matchers, name, text, size);
+    munmap(text, size);
+    return matched;
+}
+
+void usage(void)
+{
+    fprintf(stderr, "usage: cregex-grep [-c] [-o] [-n] [-i] [-u] [-j threads] (-e pattern)... | pattern [file]...\n");
+}
+
+int main(int argc, char **argv)
+{
+    settings options;
+    memset(&options, 0, sizeof(options));
+    options.threads = 1;
+    options.patterns = (const char **)malloc(argc * sizeof(char *));
+
+    int option;
+    while ((option = getopt(argc, argv, "conie:uj:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'c':
+            options.count = true;
+            break;
+        case 'o':
+            options.only = true;
+            break;
+        case 'n':
+            options.numbers = true;
+            break;
+        case 'i':
+            options.flags |= RE_ICASE;
+            break;
+        case 'u':
+            options.flags |= RE_UTF8;
+            break;
+        case 'e':
+            options.patterns[options.patternsCount++] = optarg;
+            break;
+        case 'j':
+            options.threads = atoi(optarg);
+            if (options.threads < 1)
+            {
+                usage();
+                return 2;
+            }
+            break;
+
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (options.patternsCount == 0)
+    {
+        if (optind == argc)
+        {
+            usage();
+            return 2;
+        }
+        options.patterns[options.patternsCount++] = argv[optind++];
+    }
+    options.names = argc - optind > 1;
+
+    matcher *matchers = (matcher *)calloc(options.threads, sizeof(matcher));
+    for (int t = 0; t < options.threads; t++)
+    {
+        if (!compileMatcher(&options, &matchers[t]))
+        {
+            return 2;
+        }
+    }
+
+    bool found = false, failed = false;
+    for (int i = optind; i < argc || i == optind; i++)
+    {
+        long matched = grepFile(&options, matchers, i < argc ? argv[i] : "-");
+        found = found || matched > 0;
+        failed = failed || matched < 0;
+    }
+
+    for (int t = 0; t < options.threads; t++)
+    {
+        freeMatcher(&matchers[t]);
+    }
+    free(matchers);
+    free(options.patterns);
+    return failed ? 2 : found ? 0 : 1;
+}